@@ -37,18 +37,26 @@
 #include "sharon_msgs/BoundingBoxes.h"
 #include "sharon_msgs/GetBboxes.h"
 #include "sharon_msgs/GlassesData.h"
+#include "sharon_msgs/SetObjectCategories.h"
+#include "sharon_msgs/ComputeSceneAction.h"
+
+#include "demo_sharon/reachability_map.hpp"
 
 // darknet_ros
 #include "darknet_ros_msgs/BoundingBoxes.h"
 
 // STD HEADERS
 #include <mutex>
+#include <numeric>
+#include <algorithm>
 
 #include <pthread.h>
 
 // Action interface type for moving TIAGo, provided as a typedef for convenience
 typedef actionlib::SimpleActionClient<control_msgs::FollowJointTrajectoryAction> follow_joint_control_client;
 typedef boost::shared_ptr<follow_joint_control_client> follow_joint_control_client_Ptr;
+typedef actionlib::SimpleActionClient<sharon_msgs::ComputeSceneAction> compute_scene_client;
+typedef boost::shared_ptr<compute_scene_client> compute_scene_client_Ptr;
 
 // TODO: ADD AS ROS PARAMS
 #define DISTANCE_TOOL_LINK_GRIPPER_LINK 0.185
@@ -93,6 +101,13 @@ namespace demo_sharon
 
         bool getSuperquadrics();
 
+        /** Gets the superquadrics and bounding boxes of the next sceneFrames_ frames from grasp_objects in one goal,
+         * fewer if sceneUntilStable_ and the scene is stable before.
+         * @return false if there are no superquadrics. */
+        bool computeScene();
+
+        void setObjectCategories();
+
         void addTablePlanningScene(const std::vector<float> &dimensions, const geometry_msgs::Pose &tablePose, const std::string &id);
 
         void removeCollisionObjectsPlanningScene();
@@ -162,6 +177,11 @@ namespace demo_sharon
         ros::ServiceClient clientComputeGraspPoses_;
         ros::ServiceClient clientGetSuperquadrics_;
         ros::ServiceClient clientGetBboxesSuperquadrics_;
+        ros::ServiceClient clientSetObjectCategories_;
+        compute_scene_client_Ptr computeSceneClient_;
+        int sceneFrames_ = 3;
+        float sceneTimeout_ = 10.0;
+        bool sceneUntilStable_ = true;
 
         ros::ServiceServer serviceReleaseGripper_;
         ros::ServiceServer serviceMoveToHomePosition_;
@@ -239,6 +259,8 @@ namespace demo_sharon
         robot_model::RobotModelPtr kinematicModel_;
         robot_state::RobotStatePtr kinematicState_;
         const robot_state::JointModelGroup *joint_model_group;
+        ReachabilityMap reachabilityMap_; /**< reaching poses in it go to the IK before the others*/
+        int reachabilityTopK_ = 10; /**< best scored poses reordered by the map, 0 for all of them*/
 
         std::mutex mtxASR_;
         pthread_t threadComputeGraspPoses_;
@@ -0,0 +1,83 @@
+#ifndef DEMO_SHARON_REACHABILITY_MAP_HPP
+#define DEMO_SHARON_REACHABILITY_MAP_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace demo_sharon
+{
+    /** Voxelized map of the positions and approach directions reached by the tip of an arm.
+     * Each voxel holds a 64 bit mask with one bit per discretized approach direction. The file is a fixed header
+     * followed by the masks, so it is memory mapped as is and a query is a voxel lookup plus a nearest direction search.
+     */
+    class ReachabilityMap
+    {
+    public:
+        ReachabilityMap();
+
+        ~ReachabilityMap();
+
+        ReachabilityMap(const ReachabilityMap &) = delete;
+        ReachabilityMap &operator=(const ReachabilityMap &) = delete;
+
+        /** Allocates an empty map covering the box between minCorner and maxCorner.
+         * @param nDirections approach directions spread over the sphere, at most 64. */
+        void create(const Eigen::Vector3f &minCorner, const Eigen::Vector3f &maxCorner, float voxelSize, int nDirections);
+
+        void markReachable(const Eigen::Vector3f &position, const Eigen::Vector3f &approach);
+
+        /** Adds the directions of the 26 neighbors of each voxel to it, which fills the holes left by sampling. */
+        void dilate();
+
+        bool save(const std::string &path) const;
+
+        /** Maps a map written by save(). */
+        bool load(const std::string &path);
+
+        bool loaded() const { return cells_ != nullptr; }
+
+        /** Approach directions closer than this angle (rad) to the query also count, which covers sampling holes. */
+        void setAngleTolerance(float angleTolerance);
+
+        /** @return true if the voxel of position was reached with an approach close to the given unit vector. */
+        bool isReachable(const Eigen::Vector3f &position, const Eigen::Vector3f &approach) const;
+
+        /** @return number of voxels with at least one reachable direction. */
+        int reachableVoxels() const;
+
+    private:
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t nDirections;
+            uint32_t size[3];
+            float origin[3];
+            float voxelSize;
+            uint8_t padding[12];
+        };
+        static_assert(sizeof(Header) % sizeof(uint64_t) == 0, "the masks follow the header aligned");
+
+        int voxelIndex(const Eigen::Vector3f &position) const;
+
+        int nearestDirection(const Eigen::Vector3f &approach) const;
+
+        void setDirections(int nDirections);
+
+        void unmap();
+
+        Header header_;
+        Eigen::Matrix3Xf directions_;       /**< unit approach directions, one per bit*/
+        std::vector<uint64_t> neighborMasks_; /**< directions within the angle tolerance of each direction*/
+        float angleTolerance_ = 0.35;
+        std::vector<uint64_t> ownedCells_;
+        const uint64_t *cells_ = nullptr;
+        void *mapped_ = nullptr;
+        size_t mappedSize_ = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,86 @@
+/*
+* build_reachability_map.cpp
+* Samples random configurations of a move group in the loaded robot model and writes the reachability map of its tip.
+* RoboticsLab, UC3M
+*/
+
+#include <ros/ros.h>
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/kinematics_base/kinematics_base.h>
+#include <random_numbers/random_numbers.h>
+
+#include <demo_sharon/reachability_map.hpp>
+
+
+int main(int argc, char** argv) {
+  ros::init(argc, argv, "build_reachability_map");
+  ros::NodeHandle nodeHandle("~");
+
+  std::string groupName, tipLink, output;
+  int samples, nDirections, dilations;
+  double voxelSize;
+  std::vector<double> minCorner, maxCorner;
+  nodeHandle.param("group", groupName, std::string("arm_right_torso"));
+  nodeHandle.param("tip_link", tipLink, std::string(""));
+  nodeHandle.param("output", output, std::string("reachability_arm_right_torso.bin"));
+  nodeHandle.param("samples", samples, 2000000);
+  nodeHandle.param("directions", nDirections, 32);
+  nodeHandle.param("voxel_size", voxelSize, 0.05);
+  nodeHandle.param("dilations", dilations, 1);
+  nodeHandle.param("min_corner", minCorner, std::vector<double>{-0.5, -1.3, 0.0});
+  nodeHandle.param("max_corner", maxCorner, std::vector<double>{1.3, 0.7, 1.8});
+
+  robot_model_loader::RobotModelLoader robotModelLoader("robot_description");
+  robot_model::RobotModelPtr kinematicModel = robotModelLoader.getModel();
+  if (!kinematicModel) {
+    ROS_ERROR("[BuildReachabilityMap] robot_description is not available");
+    return 1;
+  }
+  const robot_state::JointModelGroup *jointModelGroup = kinematicModel->getJointModelGroup(groupName);
+  if (jointModelGroup == nullptr) {
+    ROS_ERROR("[BuildReachabilityMap] Unknown group %s", groupName.c_str());
+    return 1;
+  }
+  // DemoSharon checks the pose given to setFromIK, which is the pose of the tip frame of the group's IK solver
+  if (tipLink.empty()) {
+    const kinematics::KinematicsBaseConstPtr &solver = jointModelGroup->getSolverInstance();
+    if (!solver) {
+      ROS_ERROR("[BuildReachabilityMap] Group %s has no IK solver, set ~tip_link", groupName.c_str());
+      return 1;
+    }
+    tipLink = solver->getTipFrame();
+  }
+  ROS_INFO("[BuildReachabilityMap] Sampling %d configurations of %s for %s in %s", samples, groupName.c_str(), tipLink.c_str(),
+           kinematicModel->getModelFrame().c_str());
+
+  demo_sharon::ReachabilityMap reachabilityMap;
+  reachabilityMap.create(Eigen::Vector3f(minCorner[0], minCorner[1], minCorner[2]), Eigen::Vector3f(maxCorner[0], maxCorner[1], maxCorner[2]),
+                         voxelSize, nDirections);
+
+  robot_state::RobotState kinematicState(kinematicModel);
+  kinematicState.setToDefaultValues();
+  random_numbers::RandomNumberGenerator rng;
+  for (int i = 0; i < samples && ros::ok(); i++) {
+    kinematicState.setToRandomPositions(jointModelGroup, rng);
+    kinematicState.updateLinkTransforms();
+    const Eigen::Isometry3d &tip = kinematicState.getGlobalLinkTransform(tipLink);
+    // The gripper approaches along the x axis of the tip
+    reachabilityMap.markReachable(tip.translation().cast<float>(), tip.linear().col(0).cast<float>());
+    if ((i + 1) % 100000 == 0)
+      ROS_INFO("[BuildReachabilityMap] %d samples, %d reachable voxels", i + 1, reachabilityMap.reachableVoxels());
+  }
+
+  // Random sampling leaves reachable voxels unmarked, growing the marked ones keeps the holes from rejecting reachable poses
+  for (int i = 0; i < dilations; i++)
+    reachabilityMap.dilate();
+  ROS_INFO("[BuildReachabilityMap] %d reachable voxels after %d dilations", reachabilityMap.reachableVoxels(), dilations);
+
+  if (!reachabilityMap.save(output)) {
+    ROS_ERROR("[BuildReachabilityMap] Unable to write %s", output.c_str());
+    return 1;
+  }
+  ROS_INFO("[BuildReachabilityMap] %d reachable voxels written to %s", reachabilityMap.reachableVoxels(), output.c_str());
+  return 0;
+}
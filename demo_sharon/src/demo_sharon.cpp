@@ -86,28 +86,14 @@ namespace demo_sharon
 
                 ros::Duration(1.5).sleep(); // sleep for 2 seconds
 
-                ROS_INFO("[DemoSharon] Start the computation of the superquadrics.");
-
-                // Start computation of the superquadrics from the pointcloud
-                activateSuperquadricsComputation(true);
-                ros::Duration(3.5).sleep(); // sleep for 2 seconds
-
-                // Stop computation of the superquadrics from the pointcloud. Our objects don't move, so there is no need to
-                // continuously recompute the superquadrics
-                ROS_INFO("[DemoSharon] Stop the computation of the superquadrics.");
-                activateSuperquadricsComputation(false);
-                ros::Duration(0.5).sleep(); // sleep for 2 seconds
-
-                ROS_INFO("[DemoSharon] Get the computed superquadrics.");
-                // Get the previously computed superquadrics
-                if (!getSuperquadrics())
+                // Superquadrics and boxes of the next frames as soon as they are computed, instead of waiting a fixed time
+                if (!computeScene())
                 { // If it's empty, there is no objects to grasp
                     return;
                 }
                 ROS_INFO("[DemoSharon] We have %d supequadrics.", (int)superquadricsMsg_.superquadrics.size());
-                ros::Duration(0.5).sleep(); // sleep for 2 seconds
 
-                if (!getBoundingBoxesFromSupercuadrics())
+                if (bboxesMsg_.bounding_boxes.empty())
                 {
                     return;
                 }
@@ -156,6 +142,7 @@ namespace demo_sharon
                 {
                     ROS_INFO("id: %d category: %s", sqCategories_[idx].idSq, sqCategories_[idx].category.c_str());
                 }
+                setObjectCategories();
 
                 state_ = WAIT_FOR_COMMAND;
             }
@@ -649,27 +636,14 @@ namespace demo_sharon
 
         initializeHeadPosition(initHeadPositions_);
 
-        ROS_INFO("[DemoSharon] Start the computation of the superquadrics.");
-        // Start computation of the superquadrics from the pointcloud
-        activateSuperquadricsComputation(true);
-        ros::Duration(0.5).sleep(); // sleep for 2 seconds
-
-        // Stop computation of the superquadrics from the pointcloud. Our objects don't move, so there is no need to
-        // continuously recompute the superquadrics
-        ROS_INFO("[DemoSharon] Stop the computation of the superquadrics.");
-        activateSuperquadricsComputation(false);
-        ros::Duration(0.5).sleep(); // sleep for 2 seconds
-
-        ROS_INFO("[DemoSharon] Get the computed superquadrics.");
-        // Get the previously computed superquadrics
-        if (!getSuperquadrics())
+        // Superquadrics and boxes of the next frames as soon as they are computed, instead of waiting a fixed time
+        if (!computeScene())
         { // If it's empty, there is no objects to grasp
             return;
         }
         ROS_INFO("[DemoSharon] We have %d supequadrics.", (int)superquadricsMsg_.superquadrics.size());
-        ros::Duration(0.5).sleep(); // sleep for 2 seconds
 
-        if (!getBoundingBoxesFromSupercuadrics())
+        if (bboxesMsg_.bounding_boxes.empty())
         {
             return;
         }
@@ -716,6 +690,7 @@ namespace demo_sharon
         {
             ROS_INFO("id: %d category: %s", sqCategories_[idx].idSq, sqCategories_[idx].category.c_str());
         }
+        setObjectCategories();
 
         addSupequadricsPlanningScene();
 
@@ -837,27 +812,14 @@ namespace demo_sharon
 
         ros::Duration(1.5).sleep(); // sleep for 2 seconds
 
-        ROS_INFO("[DemoSharon] Start the computation of the superquadrics.");
-        // Start computation of the superquadrics from the pointcloud
-        activateSuperquadricsComputation(true);
-        ros::Duration(3.5).sleep(); // sleep for 2 seconds
-
-        // Stop computation of the superquadrics from the pointcloud. Our objects don't move, so there is no need to
-        // continuously recompute the superquadrics
-        ROS_INFO("[DemoSharon] Stop the computation of the superquadrics.");
-        activateSuperquadricsComputation(false);
-        ros::Duration(0.5).sleep(); // sleep for 2 seconds
-
-        ROS_INFO("[DemoSharon] Get the computed superquadrics.");
-        // Get the previously computed superquadrics
-        if (!getSuperquadrics())
+        // Superquadrics and boxes of the next frames as soon as they are computed, instead of waiting a fixed time
+        if (!computeScene())
         { // If it's empty, there is no objects to grasp
             return;
         }
         ROS_INFO("[DemoSharon] We have %d supequadrics.", (int)superquadricsMsg_.superquadrics.size());
-        ros::Duration(0.5).sleep(); // sleep for 2 seconds
 
-        if (!getBoundingBoxesFromSupercuadrics())
+        if (bboxesMsg_.bounding_boxes.empty())
         {
             return;
         }
@@ -904,6 +866,7 @@ namespace demo_sharon
         {
             ROS_INFO("id: %d category: %s", sqCategories_[idx].idSq, sqCategories_[idx].category.c_str());
         }
+        setObjectCategories();
 
         addSupequadricsPlanningScene();
 
@@ -1559,6 +1522,10 @@ namespace demo_sharon
         clientGetSuperquadrics_ = nodeHandle_.serviceClient<sharon_msgs::GetSuperquadrics>("/grasp_objects/get_superquadrics");
         clientComputeGraspPoses_ = nodeHandle_.serviceClient<sharon_msgs::ComputeGraspPoses>("/grasp_objects/compute_grasp_poses");
         clientGetBboxesSuperquadrics_ = nodeHandle_.serviceClient<sharon_msgs::GetBboxes>("/grasp_objects/get_bboxes_superquadrics");
+        clientSetObjectCategories_ = nodeHandle_.serviceClient<sharon_msgs::SetObjectCategories>("/grasp_objects/set_object_categories");
+        computeSceneClient_.reset(new compute_scene_client("/grasp_objects/compute_scene"));
+        if (!computeSceneClient_->waitForServer(ros::Duration(5.0)))
+            ROS_ERROR("[DemoSharon] /grasp_objects/compute_scene action server not available");
         asrSubscriber_ = nodeHandle_.subscribe("/asr_node/data", 10, &DemoSharon::asrCallback, this);
         glassesDataSubscriber_ = nodeHandle_.subscribe("/comms_glasses_server/data", 10, &DemoSharon::glassesDataCallback, this);
         serviceReleaseGripper_ = nodeHandle_.advertiseService("/demo_sharon/release_gripper", &DemoSharon::releaseGripper, this);
@@ -1578,6 +1545,9 @@ namespace demo_sharon
         ros::param::get("demo_sharon/table_position2", tablePosition2_);
         ros::param::get("demo_sharon/table_dimensions2", tableDimensions2_);
 
+        ros::param::get("demo_sharon/scene_frames", sceneFrames_);
+        ros::param::get("demo_sharon/scene_timeout", sceneTimeout_);
+        ros::param::get("demo_sharon/scene_until_stable", sceneUntilStable_);
         ros::param::get("demo_sharon/right_arm_joints_position_init", initRightArmPositions_);
         ros::param::get("demo_sharon/left_arm_joints_position_init", initLeftArmPositions_);
 
@@ -1623,6 +1593,25 @@ namespace demo_sharon
         kinematicModel_ = robotModelLoader_.getModel();
         joint_model_group = kinematicModel_->getJointModelGroup(nameTorsoRightArmGroup_);
 
+        std::string reachabilityMapPath;
+        float reachabilityAngleTolerance = 0.35;
+        ros::param::get("demo_sharon/reachability_map", reachabilityMapPath);
+        ros::param::get("demo_sharon/reachability_angle_tolerance", reachabilityAngleTolerance);
+        ros::param::get("demo_sharon/reachability_top_k", reachabilityTopK_);
+        if (!reachabilityMapPath.empty())
+        {
+            if (reachabilityMap_.load(reachabilityMapPath))
+            {
+                reachabilityMap_.setAngleTolerance(reachabilityAngleTolerance);
+                ROS_INFO("[DemoSharon] Reachability map %s loaded with %d reachable voxels", reachabilityMapPath.c_str(), reachabilityMap_.reachableVoxels());
+                ROS_INFO("[DemoSharon] demo_sharon/reachability_top_k set to %d", reachabilityTopK_);
+            }
+            else
+            {
+                ROS_WARN("[DemoSharon] Unable to load the reachability map %s, the grasp poses keep their order", reachabilityMapPath.c_str());
+            }
+        }
+
         return;
     }
 
@@ -1656,6 +1645,37 @@ namespace demo_sharon
         }
     }
 
+    bool DemoSharon::computeScene()
+    {
+        sharon_msgs::ComputeSceneGoal sceneGoal;
+        sceneGoal.frames = sceneFrames_;
+        sceneGoal.timeout = sceneTimeout_;
+        sceneGoal.until_stable = sceneUntilStable_;
+        ROS_INFO("[DemoSharon] Compute the scene from %d frames.", sceneFrames_);
+        computeSceneClient_->sendGoal(sceneGoal);
+        // The server gives up at sceneTimeout_, the extra second covers the last frame in flight
+        if (!computeSceneClient_->waitForResult(ros::Duration(sceneTimeout_ > 0 ? sceneTimeout_ + 1.0 : 0.0)))
+        {
+            computeSceneClient_->cancelGoal();
+            ROS_WARN("[DemoSharon] No result from /grasp_objects/compute_scene");
+            return false;
+        }
+        sharon_msgs::ComputeSceneResultConstPtr result = computeSceneClient_->getResult();
+        // The last scene before the goal may have been taken from another head pose
+        if (result->frames == 0)
+        {
+            ROS_WARN("[DemoSharon] No frame of the goal was computed, scene %lu is discarded", (unsigned long)result->scene_version);
+            return false;
+        }
+        if (!result->success)
+            ROS_WARN("[DemoSharon] The scene was not completed, using scene %lu from %d frames", (unsigned long)result->scene_version, result->frames);
+        else if (result->stable)
+            ROS_INFO("[DemoSharon] Scene %lu is stable, confidence %f", (unsigned long)result->scene_version, result->confidence);
+        superquadricsMsg_ = result->superquadrics;
+        bboxesMsg_ = result->bounding_boxes;
+        return superquadricsMsg_.superquadrics.size() != 0;
+    }
+
     bool DemoSharon::getBoundingBoxesFromSupercuadrics()
     {
 
@@ -1675,6 +1695,21 @@ namespace demo_sharon
         }
     }
 
+    void DemoSharon::setObjectCategories()
+    {
+        // Lets grasp_objects fit the next superquadrics of these objects with their category priors
+        sharon_msgs::SetObjectCategories srvCategories;
+        for (int idx = 0; idx < sqCategories_.size(); idx++)
+        {
+            srvCategories.request.ids.push_back(sqCategories_[idx].idSq);
+            srvCategories.request.categories.push_back(sqCategories_[idx].category);
+        }
+        if (!clientSetObjectCategories_.call(srvCategories))
+        {
+            ROS_WARN("[DemoSharon] Unable to send the object categories.");
+        }
+    }
+
     void DemoSharon::activateSuperquadricsComputation(bool activate)
     {
         sharon_msgs::ActivateSupercuadricsComputation srvActivate;
@@ -1959,18 +1994,37 @@ namespace demo_sharon
         ROS_INFO("This is the thread for computing the ik feasible poses.");
         robot_state::RobotStatePtr kinematic_state(new robot_state::RobotState(kinematicModel_));
         kinematic_state->setToDefaultValues();
+        std::vector<KDL::Frame> framesReachingWrtBase(graspingPoses_.poses.size());
         for (int idx = 0; idx < graspingPoses_.poses.size(); idx++)
         {
-            ROS_INFO("[DemoSharon] idx: %d", idx);
-            ROS_INFO("Grasping Pose[%d]: %f %f %f", idx, graspingPoses_.poses[idx].position.x, graspingPoses_.poses[idx].position.y, graspingPoses_.poses[idx].position.z);
-
             KDL::Frame frameEndWrtBase;
             tf::poseMsgToKDL(graspingPoses_.poses[idx], frameEndWrtBase);
             KDL::Frame frameReachingWrtEnd;
             frameReachingWrtEnd.p[0] = -reachingDistance_ - DISTANCE_TOOL_LINK_GRIPPER_LINK;
-            KDL::Frame frameReachingWrtBase = frameEndWrtBase * frameReachingWrtEnd;
+            framesReachingWrtBase[idx] = frameEndWrtBase * frameReachingWrtEnd;
+        }
 
-            tf::poseKDLToMsg(frameReachingWrtBase, reachingPose_);
+        // The grasp poses come ranked by score. Within the best reachabilityTopK_ of them, poses in the reachability map go to the IK first,
+        // so the map only reorders poses of similar score. The map misses some reachable poses, so the others are still tried after them
+        std::vector<int> order(graspingPoses_.poses.size());
+        std::iota(order.begin(), order.end(), 0);
+        if (reachabilityMap_.loaded())
+        {
+            auto window = reachabilityTopK_ > 0 && reachabilityTopK_ < (int)order.size() ? order.begin() + reachabilityTopK_ : order.end();
+            std::stable_partition(order.begin(), window, [&](int idx)
+                                  {
+                const KDL::Frame &frame = framesReachingWrtBase[idx];
+                KDL::Vector approach = frame.M.UnitX();
+                return reachabilityMap_.isReachable(Eigen::Vector3f(frame.p.x(), frame.p.y(), frame.p.z()),
+                                                    Eigen::Vector3f(approach.x(), approach.y(), approach.z())); });
+        }
+
+        for (int idx : order)
+        {
+            ROS_INFO("[DemoSharon] idx: %d", idx);
+            ROS_INFO("Grasping Pose[%d]: %f %f %f", idx, graspingPoses_.poses[idx].position.x, graspingPoses_.poses[idx].position.y, graspingPoses_.poses[idx].position.z);
+
+            tf::poseKDLToMsg(framesReachingWrtBase[idx], reachingPose_);
 
             foundReachIk_ = kinematic_state->setFromIK(joint_model_group, reachingPose_, 0.01);
             //     geometry_msgs::PoseStamped goal_pose;
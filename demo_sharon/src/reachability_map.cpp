@@ -0,0 +1,205 @@
+#include "demo_sharon/reachability_map.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define REACHABILITY_MAP_MAGIC "SHRNRMAP"
+#define REACHABILITY_MAP_VERSION 1
+
+namespace demo_sharon
+{
+    static_assert(sizeof(uint64_t) * 8 == 64, "one bit per direction");
+
+    ReachabilityMap::ReachabilityMap()
+    {
+        std::memset(&header_, 0, sizeof(header_));
+    }
+
+    ReachabilityMap::~ReachabilityMap()
+    {
+        unmap();
+    }
+
+    void ReachabilityMap::create(const Eigen::Vector3f &minCorner, const Eigen::Vector3f &maxCorner, float voxelSize, int nDirections)
+    {
+        unmap();
+        std::memset(&header_, 0, sizeof(header_));
+        std::memcpy(header_.magic, REACHABILITY_MAP_MAGIC, sizeof(header_.magic));
+        header_.version = REACHABILITY_MAP_VERSION;
+        header_.voxelSize = voxelSize;
+        for (int i = 0; i < 3; i++)
+        {
+            header_.origin[i] = minCorner[i];
+            header_.size[i] = std::max((int)std::ceil((maxCorner[i] - minCorner[i]) / voxelSize), 1);
+        }
+        setDirections(std::min(std::max(nDirections, 1), 64));
+        ownedCells_.assign((size_t)header_.size[0] * header_.size[1] * header_.size[2], 0);
+        cells_ = ownedCells_.data();
+    }
+
+    void ReachabilityMap::setDirections(int nDirections)
+    {
+        header_.nDirections = nDirections;
+        // Fibonacci sphere, nearly uniform directions
+        directions_.resize(3, nDirections);
+        float golden = M_PI * (3.0 - std::sqrt(5.0));
+        for (int i = 0; i < nDirections; i++)
+        {
+            float z = nDirections > 1 ? 1.0 - 2.0 * (i + 0.5) / nDirections : 1.0;
+            float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            directions_.col(i) = Eigen::Vector3f(r * std::cos(golden * i), r * std::sin(golden * i), z);
+        }
+        setAngleTolerance(angleTolerance_);
+    }
+
+    void ReachabilityMap::setAngleTolerance(float angleTolerance)
+    {
+        angleTolerance_ = angleTolerance;
+        float cosTolerance = std::cos(angleTolerance);
+        int n = directions_.cols();
+        neighborMasks_.assign(n, 0);
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = 0; j < n; j++)
+            {
+                if (i == j || directions_.col(i).dot(directions_.col(j)) >= cosTolerance)
+                    neighborMasks_[i] |= uint64_t(1) << j;
+            }
+        }
+    }
+
+    int ReachabilityMap::voxelIndex(const Eigen::Vector3f &position) const
+    {
+        int idx[3];
+        for (int i = 0; i < 3; i++)
+        {
+            idx[i] = (int)std::floor((position[i] - header_.origin[i]) / header_.voxelSize);
+            if (idx[i] < 0 || idx[i] >= (int)header_.size[i])
+                return -1;
+        }
+        return (idx[2] * header_.size[1] + idx[1]) * header_.size[0] + idx[0];
+    }
+
+    int ReachabilityMap::nearestDirection(const Eigen::Vector3f &approach) const
+    {
+        int best;
+        (directions_.transpose() * approach).maxCoeff(&best);
+        return best;
+    }
+
+    void ReachabilityMap::markReachable(const Eigen::Vector3f &position, const Eigen::Vector3f &approach)
+    {
+        int idx = voxelIndex(position);
+        if (idx < 0 || ownedCells_.empty())
+            return;
+        ownedCells_[idx] |= uint64_t(1) << nearestDirection(approach);
+    }
+
+    void ReachabilityMap::dilate()
+    {
+        if (ownedCells_.empty())
+            return;
+        const int sx = header_.size[0], sy = header_.size[1], sz = header_.size[2];
+        std::vector<uint64_t> dilated(ownedCells_.size(), 0);
+        for (int z = 0; z < sz; z++)
+        {
+            for (int y = 0; y < sy; y++)
+            {
+                for (int x = 0; x < sx; x++)
+                {
+                    uint64_t mask = ownedCells_[((size_t)z * sy + y) * sx + x];
+                    if (mask == 0)
+                        continue;
+                    for (int nz = std::max(z - 1, 0); nz <= std::min(z + 1, sz - 1); nz++)
+                        for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, sy - 1); ny++)
+                            for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, sx - 1); nx++)
+                                dilated[((size_t)nz * sy + ny) * sx + nx] |= mask;
+                }
+            }
+        }
+        ownedCells_.swap(dilated);
+        cells_ = ownedCells_.data();
+    }
+
+    bool ReachabilityMap::isReachable(const Eigen::Vector3f &position, const Eigen::Vector3f &approach) const
+    {
+        if (cells_ == nullptr)
+            return false;
+        int idx = voxelIndex(position);
+        if (idx < 0)
+            return false;
+        return (cells_[idx] & neighborMasks_[nearestDirection(approach)]) != 0;
+    }
+
+    int ReachabilityMap::reachableVoxels() const
+    {
+        if (cells_ == nullptr)
+            return 0;
+        size_t n = (size_t)header_.size[0] * header_.size[1] * header_.size[2];
+        return std::count_if(cells_, cells_ + n, [](uint64_t mask)
+                             { return mask != 0; });
+    }
+
+    bool ReachabilityMap::save(const std::string &path) const
+    {
+        if (cells_ == nullptr)
+            return false;
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        size_t n = (size_t)header_.size[0] * header_.size[1] * header_.size[2];
+        file.write(reinterpret_cast<const char *>(&header_), sizeof(header_));
+        file.write(reinterpret_cast<const char *>(cells_), n * sizeof(uint64_t));
+        return (bool)file;
+    }
+
+    bool ReachabilityMap::load(const std::string &path)
+    {
+        unmap();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header))
+        {
+            close(fd);
+            return false;
+        }
+        void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+
+        const Header *header = static_cast<const Header *>(mapped);
+        size_t n = (size_t)header->size[0] * header->size[1] * header->size[2];
+        if (std::memcmp(header->magic, REACHABILITY_MAP_MAGIC, sizeof(header->magic)) != 0 || header->version != REACHABILITY_MAP_VERSION ||
+            header->nDirections == 0 || header->nDirections > 64 || (size_t)st.st_size != sizeof(Header) + n * sizeof(uint64_t))
+        {
+            munmap(mapped, st.st_size);
+            return false;
+        }
+        header_ = *header;
+        mapped_ = mapped;
+        mappedSize_ = st.st_size;
+        cells_ = reinterpret_cast<const uint64_t *>(static_cast<const char *>(mapped) + sizeof(Header));
+        setDirections(header_.nDirections);
+        return true;
+    }
+
+    void ReachabilityMap::unmap()
+    {
+        if (mapped_ != nullptr)
+            munmap(mapped_, mappedSize_);
+        mapped_ = nullptr;
+        mappedSize_ = 0;
+        ownedCells_.clear();
+        cells_ = nullptr;
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef GRASP_OBJECTS_DEBUG_PUBLISHER_HPP
+#define GRASP_OBJECTS_DEBUG_PUBLISHER_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl/point_cloud.h>
+#include <pcl_conversions/pcl_conversions.h>
+
+namespace grasp_objects
+{
+    /** Publishes debug topics only when somebody listens, at a bounded rate and off the perception thread.
+     * Callers ask wants() before building a debug product, so nothing is computed in headless operation.
+     * Conversion and serialization of the queued messages run on a publisher thread, which keeps only the
+     * latest pending message of each topic.
+     */
+    class DebugPublisher
+    {
+    public:
+        DebugPublisher();
+
+        ~DebugPublisher();
+
+        template <typename M>
+        void advertise(ros::NodeHandle &nh, const std::string &topic, double maxRate, uint32_t queueSize = 20)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            Topic &t = topics_[topic];
+            t.publisher = nh.advertise<M>(topic, queueSize);
+            t.minPeriod = ros::WallDuration(maxRate > 0 ? 1.0 / maxRate : 0.0);
+        }
+
+        /** @return true if topic has subscribers and its rate allows a new message. A true answer reserves the slot. */
+        bool wants(const std::string &topic);
+
+        /** Queues a PCL cloud to be converted and published on the publisher thread. The cloud must not change afterwards. */
+        template <typename PointT>
+        void publishCloud(const std::string &topic, const typename pcl::PointCloud<PointT>::ConstPtr &cloud, const std::string &frameId)
+        {
+            enqueue(topic, [cloud, frameId](ros::Publisher &publisher)
+                    {
+                        sensor_msgs::PointCloud2 msg;
+                        pcl::toROSMsg(*cloud, msg);
+                        msg.header.frame_id = frameId;
+                        publisher.publish(msg);
+                    });
+        }
+
+        /** Queues a message to be serialized and published on the publisher thread. */
+        template <typename M>
+        void publish(const std::string &topic, const M &msg)
+        {
+            enqueue(topic, [msg](ros::Publisher &publisher)
+                    { publisher.publish(msg); });
+        }
+
+    private:
+        struct Topic
+        {
+            ros::Publisher publisher;
+            ros::WallDuration minPeriod;
+            ros::WallTime last;
+            std::function<void(ros::Publisher &)> pending;
+        };
+
+        void enqueue(const std::string &topic, std::function<void(ros::Publisher &)> job);
+
+        void run();
+
+        std::map<std::string, Topic> topics_;
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        bool stop_ = false;
+        std::thread thread_;
+    };
+}
+
+#endif
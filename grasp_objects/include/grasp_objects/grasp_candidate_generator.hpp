@@ -0,0 +1,69 @@
+#ifndef GRASP_OBJECTS_GRASP_CANDIDATE_GENERATOR_HPP
+#define GRASP_OBJECTS_GRASP_CANDIDATE_GENERATOR_HPP
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <geometry_msgs/PoseArray.h>
+
+namespace grasp_objects
+{
+    enum GraspFace
+    {
+        GRASP_FACE_X = 1, /**< grasps on the faces normal to the x axis of the superquadric, sampled along y*/
+        GRASP_FACE_Y = 2, /**< grasps on the faces normal to the y axis of the superquadric, sampled along x*/
+        GRASP_FACE_Z = 4, /**< grasps on the faces normal to the z axis of the superquadric, sampled along x*/
+        GRASP_FACE_ALL = GRASP_FACE_X | GRASP_FACE_Y | GRASP_FACE_Z
+    };
+
+    /** Grasp candidates in structure of arrays layout, one column per candidate in the frame of the superquadric parameters. */
+    struct GraspCandidates
+    {
+        Eigen::Matrix3Xf positions;
+        Eigen::Matrix4Xf orientations; /**< quaternion coefficients x, y, z, w*/
+        Eigen::Matrix3Xf approaches;   /**< x axis of each grasp frame, the gripper moves along it to the object*/
+
+        int size() const { return positions.cols(); }
+
+        /** Keeps only the candidates at the given increasing indices. */
+        void select(const std::vector<int> &indices);
+    };
+
+    /** Samples grasp poses along the faces of a superquadric.
+     * All the candidates of a face share its orientation, so the approach angle filter is evaluated once per face
+     * and the positions of the remaining faces are transformed in a single batched product.
+     */
+    class GraspCandidateGenerator
+    {
+    public:
+        explicit GraspCandidateGenerator(float step = 0.025, int faces = GRASP_FACE_ALL, float maxObjectWidth = 0.16);
+
+        void setStep(float step);
+
+        void setFaces(int faces);
+
+        /** Sets the faces from names "x", "y" and "z". Unknown names are ignored.
+         * @return false if no valid face was given, the face set is left unchanged. */
+        bool setFaces(const std::vector<std::string> &faces);
+
+        /** @param minApproachAngle minimum angle (rad) between the z axis of the grasp and the x axis of the base. */
+        void setMinApproachAngle(float minApproachAngle);
+
+        /** @param params superquadric parameters a1, a2, a3, e1, e2, x, y, z, roll, pitch, yaw. */
+        void generate(const Eigen::VectorXd &params, GraspCandidates &candidates) const;
+
+        static void toPoseArray(const GraspCandidates &candidates, geometry_msgs::PoseArray &poses);
+
+        /** Fills poses with the candidates at the given indices, in that order. */
+        static void toPoseArray(const GraspCandidates &candidates, const std::vector<int> &order, geometry_msgs::PoseArray &poses);
+
+    private:
+        float step_;
+        int faces_;
+        float maxObjectWidth_;
+        float cosMinApproachAngle_;
+    };
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 
 #include <sensor_msgs/PointCloud2.h>
 #include <sensor_msgs/CompressedImage.h>
@@ -7,6 +8,7 @@
 #include <sensor_msgs/image_encodings.h>
 
 #include <image_transport/image_transport.h>
+#include <actionlib/server/simple_action_server.h>
 #include <tf/transform_listener.h>
 #include <kdl_conversions/kdl_msg.h>
 #include <image_geometry/pinhole_camera_model.h>
@@ -23,9 +25,19 @@
 #include <pcl/filters/extract_indices.h>
 #include <pcl/filters/passthrough.h>
 #include <pcl/segmentation/lccp_segmentation.h>
+#include <pcl/common/centroid.h>
 #include <SuperquadricLibModel/superquadricEstimator.h>
 
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <future>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <array>
 
 #include <geometry_msgs/PoseStamped.h>
 #include <geometry_msgs/PoseArray.h>
@@ -35,8 +47,25 @@
 #include "sharon_msgs/ActivateSupercuadricsComputation.h"
 #include "sharon_msgs/GetSuperquadrics.h"
 #include "sharon_msgs/ComputeGraspPoses.h"
+#include "sharon_msgs/ComputeGraspPosesBatch.h"
 #include "sharon_msgs/BoundingBoxes.h"
 #include "sharon_msgs/GetBboxes.h"
+#include "sharon_msgs/SetObjectCategories.h"
+#include "sharon_msgs/PipelineMetrics.h"
+#include "sharon_msgs/ComputeSceneAction.h"
+#include "sharon_msgs/SceneStability.h"
+
+#include "grasp_objects/point_cloud_subsampler.hpp"
+#include "grasp_objects/superq_point_cloud_adapter.hpp"
+#include "grasp_objects/superquadric_surface_sampler.hpp"
+#include "grasp_objects/debug_publisher.hpp"
+#include "grasp_objects/label_image.hpp"
+#include "grasp_objects/grasp_candidate_generator.hpp"
+#include "grasp_objects/grasp_scorer.hpp"
+#include "grasp_objects/gripper_collision_filter.hpp"
+#include "grasp_objects/stage_pipeline.hpp"
+#include "grasp_objects/scene_stability.hpp"
+#include "grasp_objects/model_shapes.hpp"
 
 #define DEFAULT_MIN_NPOINTS 100
 #define MAX_OBJECT_WIDTH_GRASP 0.16
@@ -47,6 +76,7 @@ namespace grasp_objects{
     {
         pcl::PointCloud<pcl::PointXYZRGB> object_cloud;
         int label; /**< label assigned by the lccp algorithm*/
+        int syntheticPoints = 0; /**< points added by the occlusion completion*/
         uint32_t r;
         uint32_t g;
         uint32_t b;
@@ -59,6 +89,66 @@ namespace grasp_objects{
         std::vector<SuperqModel::Superquadric> superqs;
     };
 
+    /** Result of one scene, never modified once published so the services read it without locks. */
+    struct SceneSnapshot
+    {
+        uint64_t version = 0; /**< increases by one with every published scene, 0 before the first one*/
+        std::vector<ObjectSuperquadric> objects;
+        sharon_msgs::SuperquadricMultiArray superquadrics;
+        sharon_msgs::BoundingBoxes boundingBoxes;
+        Eigen::Vector4f tablePlane = Eigen::Vector4f::Zero(); /**< normal pointing up*/
+    };
+
+    /** Data of one depth frame as it moves through the perception stages, each stage only touches its own frame. */
+    struct PerceptionFrame
+    {
+        sensor_msgs::ImageConstPtr depth;
+        uint64_t sequence = 0; /**< order of the frame among the frames processed since the node started*/
+        Eigen::Matrix4f cameraFromBase; /**< camera pose when the frame was taken*/
+        sensor_msgs::PointCloud2 cloud; /**< depth points in base_footprint, released by the filter stage*/
+        pcl::PointCloud<pcl::PointXYZ>::Ptr cloudWithoutTable;
+        Eigen::Vector4f tablePlane; /**< normal pointing up, at the default table height if no table was detected*/
+        pcl::PointCloud<pcl::PointXYZL>::Ptr labeledCloud;
+        std::vector<Object> objects;
+        cv::Mat labelImage; /**< segment label of each pixel*/
+        std::shared_ptr<SceneSnapshot> scene;
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+
+    struct SuperquadricPrior
+    {
+        std::string objectClass;      /**< object_class used to initialize and bound the estimator*/
+        std::array<float, 3> minAxes; /**< lower bounds of the sorted semi-axes*/
+        std::array<float, 3> maxAxes; /**< upper bounds of the sorted semi-axes*/
+        float minE1, maxE1;
+        float minE2, maxE2;
+    };
+
+    /** Changes of a superquadric below which its cached grasps are still used. */
+    struct GraspCacheTolerances
+    {
+        float position = 0.005;   /**< m, of the center*/
+        float size = 0.005;       /**< m, of each semi-axis*/
+        float exponent = 0.1;     /**< of e1 and e2*/
+        float orientation = 0.1;  /**< rad, angle of the relative rotation*/
+    };
+
+    struct CachedGrasps
+    {
+        std::vector<Eigen::VectorXd> superqs; /**< parameters of the superquadrics the grasps were computed for*/
+        std::vector<Eigen::VectorXd> neighbors; /**< superquadrics of the other objects when the grasps were computed*/
+        Eigen::Vector4f tablePlane;
+        geometry_msgs::PoseArray poses;
+        std::vector<float> scores;
+    };
+
+    struct CategorizedObject
+    {
+        std::string category;
+        Eigen::Vector3f centroid; /**< centroid of the superquadric when the category was assigned*/
+    };
+
 
     class GraspObjects{
         public:
@@ -71,59 +161,192 @@ namespace grasp_objects{
 
         // void pointCloudCallback(const sensor_msgs::PointCloud2ConstPtr &pointCloud_msg);
 
+        /** Runs the ingest stage of each depth image, the images are only subscribed while the computation is activated. */
         void compressedDepthImageCallback(const  sensor_msgs::ImageConstPtr &compressedImage_msg);
 
-        void setCameraParams(const sensor_msgs::CameraInfo &cameraInfo_msg);
+        /** Depth image to a cloud in base_footprint. */
+        bool ingestFrame(PerceptionFrame &frame);
+
+        /** Voxel grid, workspace limits and table plane removal. */
+        bool filterFrame(PerceptionFrame &frame);
+
+        /** LCCP segmentation into objects, and the boxes and label image of the segmentation. */
+        bool segmentFrame(PerceptionFrame &frame);
+
+        /** Completes the clouds of the objects and fits their superquadrics. */
+        bool fitFrame(PerceptionFrame &frame);
+
+        /** Publishes the scene and schedules its grasps. */
+        bool publishFrame(PerceptionFrame &frame);
+
+        /** Compares the scene of a frame with the previous one and publishes the stability when it changes. */
+        void updateSceneStability(const SceneSnapshot &scene, const PerceptionFrame &frame);
 
-        void getPixelCoordinates(const pcl::PointXYZ &p, int &xpixel, int &ypixel);
+        void publishPipelineMetrics(const ros::WallTimerEvent &event);
 
+        void setCameraParams(const sensor_msgs::CameraInfo &cameraInfo_msg);
 
         void supervoxelOversegmentation(const pcl::PointCloud<pcl::PointXYZ>::Ptr &inputPointCloud,
                                         pcl::PointCloud<pcl::PointXYZL>::Ptr &lccp_labeled_cloud);
         
-        void updateDetectedObjectsPointCloud(const pcl::PointCloud<pcl::PointXYZL>::Ptr &lccp_labeled_cloud);
+        void updateDetectedObjectsPointCloud(const pcl::PointCloud<pcl::PointXYZL>::Ptr &lccp_labeled_cloud, std::vector<Object> &detectedObjects);
+
+        /** Labels the pixels of the depth frame with the segment of their point. */
+        void buildFrameLabelImage(PerceptionFrame &frame);
+
+        /** Computes the 2d boxes of the detected objects from the organized label image of the segmentation. */
+        void computeBoundingBoxesFromLabels(PerceptionFrame &frame, sharon_msgs::BoundingBoxes &boundingBoxes);
+
+        /** Publishes the segmentation as a mono16 label image aligned with the depth frame, building it if it is not up to date. */
+        void publishLabelImage(PerceptionFrame &frame, bool labelImageUpToDate);
+
+
+        bool pclPointCloudToSuperqPointCloud(const pcl::PointCloud<pcl::PointXYZRGB> &object_cloud, const std::vector<int> &indices, SuperqModel::PointCloud &point_cloud);
 
+        /** Fits the superquadrics of one object within maxFitTime_ seconds of wall time.
+         * @return true if the fit used the whole budget, so Ipopt may have returned its best iterate before converging. */
+        bool getSuperquadricFromPointCloud(SuperqModel::PointCloud &point_cloud, const std::string &objectClass, std::vector<SuperqModel::Superquadric> &superqs);
 
-        bool pclPointCloudToSuperqPointCloud(const pcl::PointCloud<pcl::PointXYZRGB> &object_cloud, SuperqModel::PointCloud &point_cloud);
+        void loadSuperquadricPriors();
 
-        void getSuperquadricFromPointCloud(SuperqModel::PointCloud point_cloud, std::vector<SuperqModel::Superquadric> &superqs);
+        const SuperquadricPrior *findPrior(const pcl::PointCloud<pcl::PointXYZRGB> &object_cloud);
+
+        bool isPlausibleSuperquadric(const SuperquadricPrior &prior, const SuperqModel::Superquadric &superq);
+
+        bool setObjectCategories(sharon_msgs::SetObjectCategories::Request &req, sharon_msgs::SetObjectCategories::Response &res);
 
         void createPointCloudFromSuperquadric(const std::vector<SuperqModel::Superquadric> &superqs, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloudSuperquadric,
-                                             int indexDetectedObjects);
+                                             const Object &object);
 
 
         bool activateSuperquadricsComputation(sharon_msgs::ActivateSupercuadricsComputation::Request & req, sharon_msgs::ActivateSupercuadricsComputation::Response & res);
 
+        /** Subscribes to the depth images on activation and unsubscribes on deactivation, without waiting for either.
+         * @return the previous activation state. */
+        bool setActivation(bool activate);
+
+        /** Subscribes to or unsubscribes from the depth images to follow activate_, runs on the perception thread. */
+        void updateDepthSubscription();
+
+        /** Activates the computation until goal->frames new frames are published as scenes, or the scene is stable
+         * with goal->until_stable, and returns the last one. */
+        void computeScene(const sharon_msgs::ComputeSceneGoalConstPtr &goal);
+
+        /** Sends the ComputeScene feedback when a frame of the active goal finishes a stage. */
+        void reportStage(const std::string &stage, const PerceptionFrame &frame);
+
         bool computeGraspPoses(sharon_msgs::ComputeGraspPoses::Request & req, sharon_msgs::ComputeGraspPoses::Response & res);
 
-        void computeGraspingPosesObject(const std::vector<SuperqModel::Superquadric> &superqs, geometry_msgs::PoseArray &graspingPoses);
+        bool computeGraspPosesBatch(sharon_msgs::ComputeGraspPosesBatch::Request &req, sharon_msgs::ComputeGraspPosesBatch::Response &res);
+
+        /** Waits until the grasps of all ids are cached or the grasp thread has nothing left to compute, at most graspCacheTimeout_.
+         * @param lock lock of mtxGraspCache_, held on return.
+         * @return true if the grasps of all ids are cached. */
+        bool waitForGrasps(const std::vector<int> &ids, std::unique_lock<std::mutex> &lock);
+
+        /** Generates the grasp candidates of an object, drops those where the gripper collides and ranks the rest.
+         * @param neighbors superquadric parameters of the other objects.
+         * @param tablePlane table plane coefficients with the normal pointing up.
+         * @param scores score of each pose, poses are sorted from the best one. */
+        void computeGraspingPosesObject(const std::vector<Eigen::VectorXd> &superqs, const std::vector<Eigen::VectorXd> &neighbors,
+                                        const Eigen::Vector4f &tablePlane, geometry_msgs::PoseArray &graspingPoses, std::vector<float> &scores);
+
+        void loadGripperCollisionParams();
+
+        /** @return the segmented table plane with its normal pointing up, the default table height if it is not a table. */
+        Eigen::Vector4f tablePlane(const pcl::ModelCoefficients &coefficients);
+
+        /** Hands the superquadrics of a scene to the grasp thread, replacing a scene that was not processed yet. */
+        void scheduleGraspPrecomputation(const SceneSnapshot &scene);
+
+        /** @return the last published scene, readers keep it alive for as long as they hold it. */
+        std::shared_ptr<const SceneSnapshot> sceneSnapshot() const;
+
+        /** Numbers a completely built scene and replaces the published one with it. */
+        void publishSceneSnapshot(const std::shared_ptr<SceneSnapshot> &scene);
+
+        /** Keeps graspCache_ up to date with the scheduled scenes, only objects whose superquadrics changed are recomputed. */
+        void graspPrecomputationThread();
+
+        void loadGraspScoringParams();
+
+        void loadSceneStabilityParams();
+
+        void updateShoulderPosition();
 
         bool getSuperquadrics(sharon_msgs::GetSuperquadrics::Request &req, sharon_msgs::GetSuperquadrics::Response &res);
 
         bool getBboxes(sharon_msgs::GetBboxes::Request &req, sharon_msgs::GetBboxes::Response &res);
 
-        bool createBoundingBox2DFromSuperquadric(const sharon_msgs::Superquadric &superq, sharon_msgs::BoundingBox & bbox);
+        /** Projects the 8 corners of every superquadric into the image in one pass.
+         * @param markerArray if not null, the 3d bounding boxes are added to it as line list markers. */
+        void computeBoundingBoxes2D(const sharon_msgs::SuperquadricMultiArray &superquadrics, const Eigen::Matrix4f &cameraFromBase, sharon_msgs::BoundingBoxes &boundingBoxes,
+                                    visualization_msgs::MarkerArray *markerArray);
+
+        /** Completes the occluded sides and bottom of an object with voxel-spaced support points.
+         * The boundary of the object's top is extruded down to the table and the top is projected onto it.
+         * @return number of synthetic points added, never more than maxPoints. */
+        int completeObjectCloud(Object &object, float tableHeight, float distanceTop, float voxelSize, int maxPoints);
 
-        void addPointsToObjectCloud(int idx, float minHeight, float distanceTop, float distanceBtwPoints);
+        float tableHeightAt(const Eigen::Vector4f &tablePlane, float x, float y);
 
         private:
         //! ROS node handle.
         ros::NodeHandle nodeHandle_;
+        ros::NodeHandle perceptionNodeHandle_; /**< depth images are served from perceptionQueue_ so services never wait for a frame*/
+        ros::CallbackQueue perceptionQueue_;
+        std::unique_ptr<ros::AsyncSpinner> perceptionSpinner_;
         ros::Subscriber pointCloudSubscriber_;
-        image_transport::Subscriber compressedDepthImageSubscriber_;
+        std::unique_ptr<image_transport::ImageTransport> perceptionIt_;
+        image_transport::Subscriber compressedDepthImageSubscriber_; /**< only subscribed while activate_, changed on the perception thread*/
+        bool depthSubscribed_ = false;
+        std::string compressedDepthImageTopicName_;
         ros::Subscriber cameraInfoSubscriber_;
-        ros::Publisher outPointCloudPublisher_;
-        ros::Publisher outPointCloudAddedPointsPublisher_;
-        ros::Publisher outPointCloudSuperqsPublisher_;
         ros::Publisher superquadricsPublisher_;
         ros::Publisher graspPosesPublisher_;
-        ros::Publisher bbox3dPublisher_;
+        ros::Publisher boundingBoxesPublisher_;
+        image_transport::Publisher labelImagePublisher_;
+        DebugPublisher debugPublisher_;
+        GraspCandidateGenerator graspGenerator_;
+        GraspScorer graspScorer_;
+        GripperCollisionFilter gripperFilter_;
+        std::string shoulderFrame_ = "arm_right_1_link";
+        std::unordered_map<int, CachedGrasps> graspCache_; /**< ranked grasps by object label*/
+        std::vector<std::pair<int, std::vector<Eigen::VectorXd>>> pendingGraspScene_;
+        Eigen::Vector4f pendingTablePlane_;
+        bool graspScenePending_ = false;
+        bool graspCacheBusy_ = false;
+        bool stopGraspThread_ = false;
+        GraspCacheTolerances graspCacheTolerances_; /**< also applied to the table plane, its normal by orientation and its offset by position*/
+        double graspCacheTimeout_ = 2.0;
+        std::mutex mtxGraspCache_;
+        std::condition_variable cvGraspCache_;
+        std::thread graspThread_;
+        StagePipeline<std::unique_ptr<PerceptionFrame>> pipeline_;
+        int pipelineQueueCapacity_ = 1;
+        ros::Publisher pipelineMetricsPublisher_;
+        ros::WallTimer pipelineMetricsTimer_;
+        std::atomic<uint64_t> frameSequence_{0}; /**< sequence of the next frame*/
+        std::unique_ptr<actionlib::SimpleActionServer<sharon_msgs::ComputeSceneAction>> computeSceneServer_;
+        bool sceneGoalActive_ = false;
+        uint64_t sceneGoalFirstFrame_ = 0; /**< frames from this sequence on belong to the goal*/
+        int sceneGoalScenes_ = 0; /**< scenes of the goal published so far*/
+        bool sceneGoalStable_ = false; /**< the last scene of the goal was stable*/
+        float sceneGoalConfidence_ = 0;
+        bool stopComputeScene_ = false;
+        std::mutex mtxComputeScene_;
+        std::condition_variable cvComputeScene_;
+        SceneStabilityDetector stabilityDetector_; /**< only used by the publish stage*/
+        std::atomic<bool> resetStability_{false}; /**< set on activation, the scenes before it may show another table*/
+        ros::Publisher sceneStabilityPublisher_;
 
 
         ros::ServiceServer serviceActivateSuperquadricsComputation_; 
         ros::ServiceServer serviceComputeGraspPoses_;
+        ros::ServiceServer serviceComputeGraspPosesBatch_;
         ros::ServiceServer serviceGetSuperquadrics_;
         ros::ServiceServer serviceGetBboxesSuperquadrics_;
+        ros::ServiceServer serviceSetObjectCategories_;
 
 
         tf::TransformListener listener_;
@@ -140,26 +363,40 @@ namespace grasp_objects{
         float thresholdSection1_;
         float thresholdSection2_;
         int th_points_;
+        bool stratifiedSubsampling_ = false;
+        int subsamplePoints_ = 800;
+        float completionVoxelSize_ = 0.01;
+        float completionDistanceTop_ = 0.02;
+        int completionMaxPoints_ = 600;
+        float defaultTableHeight_ = 0.6;
+        std::string bboxSource_ = "label_image";
+        float labelVoxelSize_ = 0.005;
+        std::string segmentationOutput_ = "cloud";
         std::string object_class_;
         bool single_superq_;
         bool merge_model_;
+        float maxFitTime_ = 0.5;
+        float categoryAssociationRadius_ = 0.05;
+        std::map<std::string, SuperquadricPrior> priors_;
+        std::vector<CategorizedObject> categorizedObjects_;
 
         int height_ = 480;
         int width_ = 640;
         std::map<std::string,double> sq_model_params_;
         SuperqModel::SuperqEstimatorApp estim_;
+        SuperqPointCloudAdapter superqAdapter_;
+        SuperquadricSurfaceSampler surfaceSampler_;
+        int visualizationPoints_ = 2000;
 
-        std::vector<Object> detectedObjects_;
-        std::vector<ObjectSuperquadric> superquadricObjects_;
-        sharon_msgs::SuperquadricMultiArray superquadricsMsg_;
+        std::shared_ptr<const SceneSnapshot> scene_; /**< only accessed through std::atomic_load and std::atomic_store*/
+        uint64_t sceneVersion_ = 0;
+        std::mutex mtxCategories_; /**< categorizedObjects_ is written by a service and read by the perception thread*/
 
-        bool activate_ = false;
-        std::mutex mtxActivate_;
+        std::atomic<bool> activate_{false};
 
         float focalLengthX_, focalLengthY_;
         float principalPointX_, principalPointY_; 
 
-        tf::StampedTransform transformCameraWrtBase_;
         image_geometry::PinholeCameraModel model_;
 
 
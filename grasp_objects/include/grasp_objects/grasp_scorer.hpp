@@ -0,0 +1,48 @@
+#ifndef GRASP_OBJECTS_GRASP_SCORER_HPP
+#define GRASP_OBJECTS_GRASP_SCORER_HPP
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "grasp_objects/grasp_candidate_generator.hpp"
+
+namespace grasp_objects
+{
+    struct GraspScoringParams
+    {
+        float approachWeight = 1.0;     /**< approach axis aligned with the direction from the shoulder to the grasp*/
+        float reachWeight = 1.0;        /**< distance from the shoulder close to preferredReach*/
+        float clearanceWeight = 1.0;    /**< free space between the gripper and the neighbor superquadrics*/
+        float centerOfMassWeight = 1.0; /**< small lateral offset between the grasp and the center of mass*/
+        float preferredReach = 0.55;    /**< m*/
+        float reachTolerance = 0.35;    /**< m, the reach term is 0 beyond this deviation*/
+        float clearanceSaturation = 0.1; /**< m, clearances above this get the full term*/
+        float gripperLength = 0.2;      /**< m, clearance is also checked this far behind the grasp along the approach*/
+        float centerOfMassTolerance = 0.05; /**< m, the center of mass term is 0 beyond this offset*/
+        float duplicateDistance = 0.01; /**< m, candidates closer than this and duplicateAngle are merged*/
+        float duplicateAngle = 0.17;    /**< rad*/
+    };
+
+    /** Scores grasp candidates in [0, 1] and ranks them, so the first candidates are tried first by the IK. */
+    class GraspScorer
+    {
+    public:
+        void setParams(const GraspScoringParams &params);
+
+        void setShoulderPosition(const Eigen::Vector3f &shoulder);
+
+        /** Scores the candidates, sorts them by decreasing score and prunes near duplicates.
+         * @param neighbors superquadric parameters of the other objects in the scene.
+         * @param order indices of the kept candidates, best first.
+         * @param scores score of each index in order. */
+        void rank(const GraspCandidates &candidates, const Eigen::Vector3f &centerOfMass, const std::vector<Eigen::VectorXd> &neighbors,
+                  std::vector<int> &order, std::vector<float> &scores) const;
+
+    private:
+        GraspScoringParams params_;
+        Eigen::Vector3f shoulder_ = Eigen::Vector3f(0.0, -0.15, 0.9);
+    };
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef GRASP_OBJECTS_GRIPPER_COLLISION_FILTER_HPP
+#define GRASP_OBJECTS_GRIPPER_COLLISION_FILTER_HPP
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "grasp_objects/grasp_candidate_generator.hpp"
+
+namespace grasp_objects
+{
+    struct GripperBox
+    {
+        Eigen::Vector3f center;      /**< in the grasp frame*/
+        Eigen::Vector3f halfExtents;
+    };
+
+    /** Rejects grasp candidates whose gripper would overlap a neighbor superquadric or go below the table.
+     * The gripper is a few boxes in the grasp frame, approach along +x and fingers closing along z, sampled as a fixed set of points.
+     * A point collides with a superquadric if its inside-outside function is below 1.
+     */
+    class GripperCollisionFilter
+    {
+    public:
+        /** Default boxes of the PAL gripper: two fingers around the grasp point and the palm behind them. */
+        GripperCollisionFilter();
+
+        void setBoxes(const std::vector<GripperBox> &boxes);
+
+        /** @param pointsPerEdge points sampled along each edge of a box, at least 2 (the corners). */
+        void setPointsPerEdge(int pointsPerEdge);
+
+        /** @param tableMargin points closer than this to the table plane collide with it. */
+        void setTableMargin(float tableMargin);
+
+        /** @param neighbors superquadric parameters a1, a2, a3, e1, e2, x, y, z, roll, pitch, yaw of the other objects.
+         * @param tablePlane table plane coefficients with the normal pointing up.
+         * @param free indices of the candidates that do not collide. */
+        void filter(const GraspCandidates &candidates, const std::vector<Eigen::VectorXd> &neighbors, const Eigen::Vector4f &tablePlane,
+                    std::vector<int> &free) const;
+
+    private:
+        void samplePoints();
+
+        std::vector<GripperBox> boxes_;
+        int pointsPerEdge_ = 3;
+        float tableMargin_ = 0.01;
+        Eigen::Matrix3Xf points_; /**< gripper points in the grasp frame*/
+        float radius_ = 0;        /**< bounding radius of points_ around the grasp origin*/
+    };
+}
+
+#endif
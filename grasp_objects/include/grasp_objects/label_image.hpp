@@ -0,0 +1,42 @@
+#ifndef GRASP_OBJECTS_LABEL_IMAGE_HPP
+#define GRASP_OBJECTS_LABEL_IMAGE_HPP
+
+#include <cstdint>
+#include <map>
+
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace grasp_objects
+{
+    struct CameraIntrinsics
+    {
+        int width, height;
+        float focalLengthX, focalLengthY;
+        float principalPointX, principalPointY;
+    };
+
+    struct LabelBox
+    {
+        int tlx, tly, brx, bry;
+        int pixelCount;
+    };
+
+    /** Builds an organized CV_16UC1 image with the segment label of each pixel, 0 where there is no object.
+     * Each pixel of the depth image the cloud comes from is back-projected and takes the label of the closest labeled point
+     * within one voxel diagonal, so only pixels whose own point was segmented are labeled. Where another surface touches
+     * an object, its pixels within that distance of the object are labeled too.
+     * @param depth depth image, CV_32FC1 in m or CV_16UC1 in mm.
+     * @param cameraFromBase transform from the cloud frame to the camera optical frame.
+     * @param voxelSize leaf size of the voxel grid the labeled points come from.
+     */
+    void buildLabelImage(const pcl::PointCloud<pcl::PointXYZL> &cloud, const cv::Mat &depth, const Eigen::Matrix4f &cameraFromBase,
+                         const CameraIntrinsics &intrinsics, float voxelSize, cv::Mat &labelImage);
+
+    /** Computes the tight 2d bounding box and pixel count of every label in one pass over the image. */
+    void computeLabelBoxes(const cv::Mat &labelImage, std::map<uint16_t, LabelBox> &boxes);
+}
+
+#endif
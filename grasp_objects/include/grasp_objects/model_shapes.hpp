@@ -0,0 +1,29 @@
+#ifndef GRASP_OBJECTS_MODEL_SHAPES_HPP
+#define GRASP_OBJECTS_MODEL_SHAPES_HPP
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace grasp_objects
+{
+    struct ModelShape
+    {
+        std::string name;              /**< name of the model directory*/
+        std::string objectClass;       /**< box or cylinder*/
+        std::array<float, 3> semiAxes; /**< sorted, m*/
+    };
+
+    /** Reads the collision geometry of a Gazebo model.
+     * @return false if the file cannot be parsed or the model has other than a single box or cylinder collision. */
+    bool readModelShape(const std::string &sdfPath, ModelShape &shape);
+
+    /** Reads the shape of every model in a Gazebo models directory, one model.sdf per subdirectory.
+     * Models without a single box or cylinder collision are skipped. */
+    void readModelShapes(const std::string &modelsPath, std::vector<ModelShape> &shapes);
+
+    /** @return the category of a model, its name without the trailing digits of the model variants (milk1, milk2 -> milk). */
+    std::string modelCategory(const std::string &modelName);
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef GRASP_OBJECTS_POINT_CLOUD_SUBSAMPLER_HPP
+#define GRASP_OBJECTS_POINT_CLOUD_SUBSAMPLER_HPP
+
+#include <vector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace grasp_objects
+{
+    /** Deterministic voxel-stratified subsampling with a fixed point budget.
+     * The voxel size is adapted until the occupied voxels nearly fill the budget and the point closest to the center
+     * of each voxel is kept, so every part of the object surface (sides, silhouette and top) stays represented.
+     * @param cloud object cloud to subsample.
+     * @param budget maximum number of indices returned.
+     * @param indices sorted indices of the selected points of cloud.
+     */
+    void voxelStratifiedSubsample(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, int budget, std::vector<int> &indices);
+}
+
+#endif
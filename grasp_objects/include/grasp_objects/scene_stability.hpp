@@ -0,0 +1,55 @@
+#ifndef GRASP_OBJECTS_SCENE_STABILITY_HPP
+#define GRASP_OBJECTS_SCENE_STABILITY_HPP
+
+#include <deque>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace grasp_objects
+{
+    struct SceneStabilityParams
+    {
+        int frames = 3;                /**< consecutive consistent scenes for the scene to be stable, at least 2*/
+        float maxCentroidDrift = 0.01; /**< m, between an object and its match in the previous scene*/
+        float maxAxisDelta = 0.01;     /**< m, change of each sorted semi-axis*/
+        float maxExponentDelta = 0.2;  /**< change of e1 and e2*/
+    };
+
+    /** Decides when consecutive scenes agree, so clients can stop the computation once more frames would not change the result.
+     * Two scenes are consistent if they have the same number of objects and every object has a match in the previous scene
+     * within the centroid, semi-axes and exponent thresholds. Objects are matched by centroid, the segment labels change between frames.
+     */
+    class SceneStabilityDetector
+    {
+    public:
+        void setParams(const SceneStabilityParams &params);
+
+        /** Forgets the previous scenes, the next one starts a new count. */
+        void reset();
+
+        /** Compares a scene with the previous one.
+         * @param objects superquadric parameters a1, a2, a3, e1, e2, x, y, z, ... of each object.
+         * @return true if the last params.frames scenes are consistent. */
+        bool update(const std::vector<Eigen::VectorXd> &objects);
+
+        bool stable() const;
+
+        /** @return consecutive scenes consistent with the one before them, counting the first. */
+        int consistentFrames() const;
+
+        /** @return 1 minus the mean change of the stable scenes relative to the thresholds, 0 if the scene is not stable. */
+        float confidence() const;
+
+    private:
+        /** @return largest change of an object relative to its threshold, above 1 if the scenes are not consistent. */
+        float change(const std::vector<Eigen::VectorXd> &previous, const std::vector<Eigen::VectorXd> &current) const;
+
+        SceneStabilityParams params_;
+        std::vector<Eigen::VectorXd> previous_;
+        int consistentFrames_ = 0;
+        std::deque<float> changes_; /**< relative change of the last params_.frames - 1 consistent comparisons*/
+    };
+}
+
+#endif
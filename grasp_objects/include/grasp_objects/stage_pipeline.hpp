@@ -0,0 +1,218 @@
+#ifndef GRASP_OBJECTS_STAGE_PIPELINE_HPP
+#define GRASP_OBJECTS_STAGE_PIPELINE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace grasp_objects
+{
+    /** Bounded FIFO between one producer and one consumer thread.
+     * push() blocks while the queue is full, so a slow consumer holds back its producer instead of piling up frames.
+     */
+    template <typename T>
+    class SpscQueue
+    {
+    public:
+        explicit SpscQueue(size_t capacity) : slots_(std::max<size_t>(capacity, 1)) {}
+
+        /** @return false if the queue was closed, the item is dropped. */
+        bool push(T &&item)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            notFull_.wait(lock, [this]
+                          { return closed_ || count_ < slots_.size(); });
+            if (closed_)
+                return false;
+            slots_[(head_ + count_) % slots_.size()] = std::move(item);
+            count_++;
+            lock.unlock();
+            notEmpty_.notify_one();
+            return true;
+        }
+
+        /** @return false if the queue was closed. */
+        bool pop(T &item)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            notEmpty_.wait(lock, [this]
+                           { return closed_ || count_ > 0; });
+            if (closed_)
+                return false;
+            item = std::move(slots_[head_]);
+            head_ = (head_ + 1) % slots_.size();
+            count_--;
+            lock.unlock();
+            notFull_.notify_one();
+            return true;
+        }
+
+        /** Wakes up the producer and the consumer, every later push and pop fails. */
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                closed_ = true;
+            }
+            notFull_.notify_all();
+            notEmpty_.notify_all();
+        }
+
+        size_t size()
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return count_;
+        }
+
+        size_t capacity() const { return slots_.size(); }
+
+    private:
+        std::vector<T> slots_;
+        size_t head_ = 0;
+        size_t count_ = 0;
+        bool closed_ = false;
+        std::mutex mtx_;
+        std::condition_variable notFull_;
+        std::condition_variable notEmpty_;
+    };
+
+    struct PipelineMetrics
+    {
+        std::vector<std::string> stages;
+        std::vector<float> occupancy;         /**< fraction of the period each stage spent working*/
+        std::vector<uint32_t> queueDepth;     /**< frames waiting in front of each stage, 0 for the first one*/
+        std::vector<uint32_t> queueCapacity;
+        std::vector<uint32_t> frames;         /**< frames each stage finished in the period*/
+        double period = 0;                    /**< s*/
+    };
+
+    /** Runs a frame through a chain of stages, each one on its own thread.
+     * The first stage runs on the thread calling process(). The others are connected by bounded SpscQueues,
+     * so frame N+1 goes through the early stages while frame N is still in the later ones.
+     * A stage returning false drops its frame.
+     */
+    template <typename Frame>
+    class StagePipeline
+    {
+    public:
+        using Stage = std::function<bool(Frame &)>;
+        using Observer = std::function<void(const std::string &, const Frame &)>;
+
+        ~StagePipeline()
+        {
+            stop();
+        }
+
+        /** Appends a stage, only before start(). */
+        void addStage(const std::string &name, Stage stage)
+        {
+            std::unique_ptr<StageState> state(new StageState);
+            state->name = name;
+            state->run = std::move(stage);
+            stages_.push_back(std::move(state));
+        }
+
+        /** Called on the stage thread each time a stage keeps its frame, only before start(). */
+        void setObserver(Observer observer)
+        {
+            observer_ = std::move(observer);
+        }
+
+        void start(size_t queueCapacity)
+        {
+            lastMetrics_ = std::chrono::steady_clock::now();
+            for (size_t i = 1; i < stages_.size(); i++)
+                stages_[i]->input.reset(new SpscQueue<Frame>(queueCapacity));
+            for (size_t i = 1; i < stages_.size(); i++)
+                stages_[i]->thread = std::thread(&StagePipeline::runThread, this, i);
+        }
+
+        /** Runs the first stage on the calling thread and hands the frame to the second one, waiting while its queue is full.
+         * @return false if the frame was dropped or the pipeline is stopped. */
+        bool process(Frame &&frame)
+        {
+            if (stages_.empty() || !runStage(*stages_[0], frame))
+                return false;
+            return stages_.size() == 1 || stages_[1]->input->push(std::move(frame));
+        }
+
+        /** Frames still in the queues are discarded, the stages finish the frame they are working on. */
+        void stop()
+        {
+            for (auto &stage : stages_)
+                if (stage->input)
+                    stage->input->close();
+            for (auto &stage : stages_)
+                if (stage->thread.joinable())
+                    stage->thread.join();
+        }
+
+        /** Fills the metrics accumulated since the previous call and starts a new period. */
+        void metrics(PipelineMetrics &metrics)
+        {
+            auto now = std::chrono::steady_clock::now();
+            double period = std::chrono::duration<double>(now - lastMetrics_).count();
+            lastMetrics_ = now;
+            metrics = PipelineMetrics();
+            metrics.period = period;
+            for (auto &stage : stages_)
+            {
+                double busy = stage->busyNs.exchange(0) * 1e-9;
+                metrics.stages.push_back(stage->name);
+                metrics.occupancy.push_back(period > 0 ? std::min(busy / period, 1.0) : 0.0);
+                metrics.frames.push_back(stage->frames.exchange(0));
+                metrics.queueDepth.push_back(stage->input ? stage->input->size() : 0);
+                metrics.queueCapacity.push_back(stage->input ? stage->input->capacity() : 0);
+            }
+        }
+
+    private:
+        struct StageState
+        {
+            std::string name;
+            Stage run;
+            std::unique_ptr<SpscQueue<Frame>> input; /**< null for the first stage*/
+            std::thread thread;
+            std::atomic<int64_t> busyNs{0};
+            std::atomic<uint32_t> frames{0};
+        };
+
+        bool runStage(StageState &stage, Frame &frame)
+        {
+            auto begin = std::chrono::steady_clock::now();
+            bool kept = stage.run(frame);
+            stage.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+            stage.frames++;
+            if (kept && observer_)
+                observer_(stage.name, frame);
+            return kept;
+        }
+
+        void runThread(size_t i)
+        {
+            StageState &stage = *stages_[i];
+            Frame frame;
+            while (stage.input->pop(frame))
+            {
+                if (!runStage(stage, frame))
+                    continue;
+                if (i + 1 < stages_.size() && !stages_[i + 1]->input->push(std::move(frame)))
+                    return;
+            }
+        }
+
+        std::vector<std::unique_ptr<StageState>> stages_;
+        Observer observer_;
+        std::chrono::steady_clock::time_point lastMetrics_;
+    };
+}
+
+#endif
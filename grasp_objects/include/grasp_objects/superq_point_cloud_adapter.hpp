@@ -0,0 +1,31 @@
+#ifndef GRASP_OBJECTS_SUPERQ_POINT_CLOUD_ADAPTER_HPP
+#define GRASP_OBJECTS_SUPERQ_POINT_CLOUD_ADAPTER_HPP
+
+#include <deque>
+#include <vector>
+
+#include <Eigen/Core>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <SuperquadricLibModel/pointCloud.h>
+
+namespace grasp_objects
+{
+    /** Converts PCL object clouds for the superquadric estimator.
+     * The selected points are gathered into a buffer kept across objects and frames, which is handed to PointCloud::setPoints.
+     * Colors are not copied, the estimator does not read them.
+     */
+    class SuperqPointCloudAdapter
+    {
+    public:
+        /** Sets the points of cloud selected by indices as the points of point_cloud.
+         * @return false, leaving point_cloud untouched, if there are less than minimumPoints indices. */
+        bool toSuperqPointCloud(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const std::vector<int> &indices, int minimumPoints,
+                                SuperqModel::PointCloud &point_cloud);
+
+    private:
+        std::deque<Eigen::Vector3d> points_; /**< setPoints takes a deque, resized in place instead of rebuilt per object*/
+    };
+}
+
+#endif
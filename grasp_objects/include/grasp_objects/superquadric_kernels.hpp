@@ -0,0 +1,312 @@
+#ifndef GRASP_OBJECTS_SUPERQUADRIC_KERNELS_HPP
+#define GRASP_OBJECTS_SUPERQUADRIC_KERNELS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/** Batched superquadric kernels over structure of arrays float buffers.
+ * Points are given as separate x, y, z arrays in the frame of the superquadric parameters. With -mavx2 (CMake option
+ * GRASP_OBJECTS_AVX2) eight points are evaluated per loop iteration, the tail and other builds use the scalar path.
+ * The inside-outside function is F = (|x/a1|^(2/e2) + |y/a2|^(2/e2))^(e2/e1) + |z/a3|^(2/e1) in the superquadric frame.
+ */
+namespace grasp_objects
+{
+    namespace kernels
+    {
+        /** Superquadric with the quantities the kernels need precomputed. */
+        struct SuperquadricShape
+        {
+            float rotation[9]; /**< row major, superquadric frame to parameters frame*/
+            float center[3];
+            float invAxes[3];
+            float e1, e2;
+            float exponentXY; /**< 2/e2*/
+            float exponentA;  /**< e2/e1*/
+            float exponentZ;  /**< 2/e1*/
+        };
+
+        /** @param params superquadric parameters a1, a2, a3, e1, e2, x, y, z, roll, pitch, yaw. */
+        inline SuperquadricShape makeShape(const Eigen::VectorXd &params)
+        {
+            SuperquadricShape shape;
+            Eigen::Matrix3f rotation = (Eigen::AngleAxisf(params[8], Eigen::Vector3f::UnitZ()) *
+                                        Eigen::AngleAxisf(params[9], Eigen::Vector3f::UnitY()) *
+                                        Eigen::AngleAxisf(params[10], Eigen::Vector3f::UnitZ()))
+                                           .toRotationMatrix();
+            for (int i = 0; i < 3; i++)
+            {
+                for (int j = 0; j < 3; j++)
+                    shape.rotation[3 * i + j] = rotation(i, j);
+                shape.center[i] = params[5 + i];
+                shape.invAxes[i] = 1.0 / params[i];
+            }
+            shape.e1 = params[3];
+            shape.e2 = params[4];
+            shape.exponentXY = 2.0f / shape.e2;
+            shape.exponentA = shape.e2 / shape.e1;
+            shape.exponentZ = 2.0f / shape.e1;
+            return shape;
+        }
+
+        namespace detail
+        {
+            inline float signedPow(float v, float e)
+            {
+                return std::copysign(std::pow(std::abs(v), e), v);
+            }
+
+            /** Point in the superquadric frame, scaled by the inverse semi-axes. */
+            inline void toUnit(const SuperquadricShape &s, float x, float y, float z, float &ux, float &uy, float &uz)
+            {
+                float dx = x - s.center[0], dy = y - s.center[1], dz = z - s.center[2];
+                ux = (s.rotation[0] * dx + s.rotation[3] * dy + s.rotation[6] * dz) * s.invAxes[0];
+                uy = (s.rotation[1] * dx + s.rotation[4] * dy + s.rotation[7] * dz) * s.invAxes[1];
+                uz = (s.rotation[2] * dx + s.rotation[5] * dy + s.rotation[8] * dz) * s.invAxes[2];
+            }
+
+            inline float insideOutside(const SuperquadricShape &s, float x, float y, float z)
+            {
+                float ux, uy, uz;
+                toUnit(s, x, y, z, ux, uy, uz);
+                return std::pow(std::pow(std::abs(ux), s.exponentXY) + std::pow(std::abs(uy), s.exponentXY), s.exponentA) +
+                       std::pow(std::abs(uz), s.exponentZ);
+            }
+
+            inline void gradient(const SuperquadricShape &s, float x, float y, float z, float &gx, float &gy, float &gz)
+            {
+                float ux, uy, uz;
+                toUnit(s, x, y, z, ux, uy, uz);
+                float a = std::max(std::pow(std::abs(ux), s.exponentXY) + std::pow(std::abs(uy), s.exponentXY), std::numeric_limits<float>::min());
+                float common = s.exponentZ * std::pow(a, s.exponentA - 1.0f);
+                float lx = common * signedPow(ux, s.exponentXY - 1.0f) * s.invAxes[0];
+                float ly = common * signedPow(uy, s.exponentXY - 1.0f) * s.invAxes[1];
+                float lz = s.exponentZ * signedPow(uz, s.exponentZ - 1.0f) * s.invAxes[2];
+                gx = s.rotation[0] * lx + s.rotation[1] * ly + s.rotation[2] * lz;
+                gy = s.rotation[3] * lx + s.rotation[4] * ly + s.rotation[5] * lz;
+                gz = s.rotation[6] * lx + s.rotation[7] * ly + s.rotation[8] * lz;
+            }
+
+            inline float radialDistance(const SuperquadricShape &s, float x, float y, float z)
+            {
+                float dx = x - s.center[0], dy = y - s.center[1], dz = z - s.center[2];
+                float norm = std::sqrt(dx * dx + dy * dy + dz * dz);
+                float f = insideOutside(s, x, y, z);
+                // The surface along the ray from the center is at F^(-e1/2) of the point
+                return f > 0 ? norm * (1.0f - std::pow(f, -s.e1 / 2.0f)) : -1.0f / std::max({s.invAxes[0], s.invAxes[1], s.invAxes[2]});
+            }
+
+#ifdef __AVX2__
+            // Cephes style single precision exp and log, accurate to a few ulp in the range the kernels use
+
+            inline __m256 exp256(__m256 x)
+            {
+                x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3f)), _mm256_set1_ps(88.3f));
+                __m256 fx = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+                x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(0.693359375f)));
+                x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(-2.12194440e-4f)));
+                __m256 z = _mm256_mul_ps(x, x);
+                __m256 y = _mm256_set1_ps(1.9875691500E-4f);
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.3981999507E-3f));
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(8.3334519073E-3f));
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(4.1665795894E-2f));
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.6666665459E-1f));
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(5.0000001201E-1f));
+                y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(y, z), x), _mm256_set1_ps(1.0f));
+                __m256i n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(fx), _mm256_set1_epi32(127)), 23);
+                return _mm256_mul_ps(y, _mm256_castsi256_ps(n));
+            }
+
+            /** Natural logarithm of positive normal numbers. */
+            inline __m256 log256(__m256 x)
+            {
+                __m256i bits = _mm256_castps_si256(x);
+                __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+                // Mantissa in [0.5, 1)
+                x = _mm256_or_ps(_mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(0x807fffff))), _mm256_set1_ps(0.5f));
+                __m256 small = _mm256_cmp_ps(x, _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+                e = _mm256_sub_ps(e, _mm256_and_ps(small, _mm256_set1_ps(1.0f)));
+                x = _mm256_add_ps(_mm256_sub_ps(x, _mm256_set1_ps(1.0f)), _mm256_and_ps(small, x));
+                __m256 z = _mm256_mul_ps(x, x);
+                __m256 y = _mm256_set1_ps(7.0376836292E-2f);
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(-1.1514610310E-1f));
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.1676998740E-1f));
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(-1.2420140846E-1f));
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.4249322787E-1f));
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(-1.6668057665E-1f));
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(2.0000714765E-1f));
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(-2.4999993993E-1f));
+                y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(3.3333331174E-1f));
+                y = _mm256_mul_ps(_mm256_mul_ps(y, x), z);
+                y = _mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(-2.12194440e-4f)));
+                y = _mm256_sub_ps(y, _mm256_mul_ps(z, _mm256_set1_ps(0.5f)));
+                return _mm256_add_ps(_mm256_add_ps(x, y), _mm256_mul_ps(e, _mm256_set1_ps(0.693359375f)));
+            }
+
+            inline __m256 abs256(__m256 x)
+            {
+                return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+            }
+
+            /** |x|^e, 0 where x is 0. */
+            inline __m256 absPow256(__m256 x, __m256 e)
+            {
+                __m256 a = abs256(x);
+                __m256 zero = _mm256_cmp_ps(a, _mm256_set1_ps(std::numeric_limits<float>::min()), _CMP_LT_OQ);
+                __m256 p = exp256(_mm256_mul_ps(e, log256(_mm256_max_ps(a, _mm256_set1_ps(std::numeric_limits<float>::min())))));
+                return _mm256_andnot_ps(zero, p);
+            }
+
+            inline __m256 signedPow256(__m256 x, __m256 e)
+            {
+                __m256 sign = _mm256_and_ps(x, _mm256_set1_ps(-0.0f));
+                return _mm256_or_ps(absPow256(x, e), sign);
+            }
+
+            inline void toUnit256(const SuperquadricShape &s, __m256 x, __m256 y, __m256 z, __m256 &ux, __m256 &uy, __m256 &uz)
+            {
+                __m256 dx = _mm256_sub_ps(x, _mm256_set1_ps(s.center[0]));
+                __m256 dy = _mm256_sub_ps(y, _mm256_set1_ps(s.center[1]));
+                __m256 dz = _mm256_sub_ps(z, _mm256_set1_ps(s.center[2]));
+                __m256 u[3];
+                for (int j = 0; j < 3; j++)
+                {
+                    u[j] = _mm256_mul_ps(dx, _mm256_set1_ps(s.rotation[j]));
+                    u[j] = _mm256_add_ps(u[j], _mm256_mul_ps(dy, _mm256_set1_ps(s.rotation[3 + j])));
+                    u[j] = _mm256_add_ps(u[j], _mm256_mul_ps(dz, _mm256_set1_ps(s.rotation[6 + j])));
+                    u[j] = _mm256_mul_ps(u[j], _mm256_set1_ps(s.invAxes[j]));
+                }
+                ux = u[0];
+                uy = u[1];
+                uz = u[2];
+            }
+
+            inline __m256 insideOutside256(const SuperquadricShape &s, __m256 x, __m256 y, __m256 z)
+            {
+                __m256 ux, uy, uz;
+                toUnit256(s, x, y, z, ux, uy, uz);
+                __m256 exponentXY = _mm256_set1_ps(s.exponentXY);
+                __m256 a = _mm256_add_ps(absPow256(ux, exponentXY), absPow256(uy, exponentXY));
+                return _mm256_add_ps(absPow256(a, _mm256_set1_ps(s.exponentA)), absPow256(uz, _mm256_set1_ps(s.exponentZ)));
+            }
+#endif
+        }
+
+        /** out[i] = sign(v[i]) |v[i]|^e */
+        inline void signedPow(const float *v, float e, float *out, int n)
+        {
+            int i = 0;
+#ifdef __AVX2__
+            __m256 exponent = _mm256_set1_ps(e);
+            for (; i + 8 <= n; i += 8)
+                _mm256_storeu_ps(out + i, detail::signedPow256(_mm256_loadu_ps(v + i), exponent));
+#endif
+            for (; i < n; i++)
+                out[i] = detail::signedPow(v[i], e);
+        }
+
+        inline float insideOutside(const SuperquadricShape &shape, float x, float y, float z)
+        {
+            return detail::insideOutside(shape, x, y, z);
+        }
+
+        /** f[i] = F of point i, below 1 inside the superquadric. */
+        inline void insideOutside(const SuperquadricShape &shape, const float *x, const float *y, const float *z, float *f, int n)
+        {
+            int i = 0;
+#ifdef __AVX2__
+            for (; i + 8 <= n; i += 8)
+                _mm256_storeu_ps(f + i, detail::insideOutside256(shape, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), _mm256_loadu_ps(z + i)));
+#endif
+            for (; i < n; i++)
+                f[i] = detail::insideOutside(shape, x[i], y[i], z[i]);
+        }
+
+        /** f[i] = minimum F of point i over all the shapes, below 1 if the point is inside any of them. */
+        inline void insideOutsideMin(const std::vector<SuperquadricShape> &shapes, const float *x, const float *y, const float *z, float *f, int n)
+        {
+            std::fill(f, f + n, std::numeric_limits<float>::max());
+            std::vector<float> shapeF(n);
+            for (const SuperquadricShape &shape : shapes)
+            {
+                insideOutside(shape, x, y, z, shapeF.data(), n);
+                for (int i = 0; i < n; i++)
+                    f[i] = std::min(f[i], shapeF[i]);
+            }
+        }
+
+        /** Gradient of F in the frame of the superquadric parameters. */
+        inline void gradient(const SuperquadricShape &shape, const float *x, const float *y, const float *z, float *gx, float *gy, float *gz, int n)
+        {
+            int i = 0;
+#ifdef __AVX2__
+            __m256 exponentXY = _mm256_set1_ps(shape.exponentXY);
+            __m256 exponentXYm1 = _mm256_set1_ps(shape.exponentXY - 1.0f);
+            __m256 exponentZ = _mm256_set1_ps(shape.exponentZ);
+            __m256 exponentZm1 = _mm256_set1_ps(shape.exponentZ - 1.0f);
+            __m256 exponentAm1 = _mm256_set1_ps(shape.exponentA - 1.0f);
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256 ux, uy, uz;
+                detail::toUnit256(shape, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), _mm256_loadu_ps(z + i), ux, uy, uz);
+                __m256 a = _mm256_add_ps(detail::absPow256(ux, exponentXY), detail::absPow256(uy, exponentXY));
+                a = _mm256_max_ps(a, _mm256_set1_ps(std::numeric_limits<float>::min()));
+                __m256 common = _mm256_mul_ps(exponentZ, detail::absPow256(a, exponentAm1));
+                __m256 l[3];
+                l[0] = _mm256_mul_ps(_mm256_mul_ps(common, detail::signedPow256(ux, exponentXYm1)), _mm256_set1_ps(shape.invAxes[0]));
+                l[1] = _mm256_mul_ps(_mm256_mul_ps(common, detail::signedPow256(uy, exponentXYm1)), _mm256_set1_ps(shape.invAxes[1]));
+                l[2] = _mm256_mul_ps(_mm256_mul_ps(exponentZ, detail::signedPow256(uz, exponentZm1)), _mm256_set1_ps(shape.invAxes[2]));
+                float *g[3] = {gx + i, gy + i, gz + i};
+                for (int r = 0; r < 3; r++)
+                {
+                    __m256 v = _mm256_mul_ps(l[0], _mm256_set1_ps(shape.rotation[3 * r]));
+                    v = _mm256_add_ps(v, _mm256_mul_ps(l[1], _mm256_set1_ps(shape.rotation[3 * r + 1])));
+                    v = _mm256_add_ps(v, _mm256_mul_ps(l[2], _mm256_set1_ps(shape.rotation[3 * r + 2])));
+                    _mm256_storeu_ps(g[r], v);
+                }
+            }
+#endif
+            for (; i < n; i++)
+                detail::gradient(shape, x[i], y[i], z[i], gx[i], gy[i], gz[i]);
+        }
+
+        /** Approximate euclidean distance from each point to the surface along the ray from the center, negative inside. */
+        inline void radialDistance(const SuperquadricShape &shape, const float *x, const float *y, const float *z, float *d, int n)
+        {
+            int i = 0;
+#ifdef __AVX2__
+            __m256 exponent = _mm256_set1_ps(-shape.e1 / 2.0f);
+            __m256 inside = _mm256_set1_ps(-1.0f / std::max({shape.invAxes[0], shape.invAxes[1], shape.invAxes[2]}));
+            for (; i + 8 <= n; i += 8)
+            {
+                __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+                __m256 dx = _mm256_sub_ps(px, _mm256_set1_ps(shape.center[0]));
+                __m256 dy = _mm256_sub_ps(py, _mm256_set1_ps(shape.center[1]));
+                __m256 dz = _mm256_sub_ps(pz, _mm256_set1_ps(shape.center[2]));
+                __m256 norm = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+                __m256 f = detail::insideOutside256(shape, px, py, pz);
+                __m256 dist = _mm256_mul_ps(norm, _mm256_sub_ps(_mm256_set1_ps(1.0f), detail::absPow256(f, exponent)));
+                __m256 atCenter = _mm256_cmp_ps(f, _mm256_set1_ps(0.0f), _CMP_LE_OQ);
+                _mm256_storeu_ps(d + i, _mm256_blendv_ps(dist, inside, atCenter));
+            }
+#endif
+            for (; i < n; i++)
+                d[i] = detail::radialDistance(shape, x[i], y[i], z[i]);
+        }
+
+        inline float radialDistance(const SuperquadricShape &shape, float x, float y, float z)
+        {
+            return detail::radialDistance(shape, x, y, z);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef GRASP_OBJECTS_SUPERQUADRIC_SURFACE_SAMPLER_HPP
+#define GRASP_OBJECTS_SUPERQUADRIC_SURFACE_SAMPLER_HPP
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+namespace grasp_objects
+{
+    /** Samples points on the surface of superquadrics with the (eta, omega) parameterization.
+     * The unit surface of each pair of shape exponents is computed once and cached, so sampling an object
+     * only scales, rotates and translates a fixed number of points.
+     */
+    class SuperquadricSurfaceSampler
+    {
+    public:
+        /** @param nPoints approximate number of surface points per superquadric. */
+        explicit SuperquadricSurfaceSampler(int nPoints = 2000);
+
+        void setNumberPoints(int nPoints);
+
+        /** Appends the surface points of a superquadric to cloud.
+         * @param params superquadric parameters a1, a2, a3, e1, e2, x, y, z, roll, pitch, yaw. */
+        void sample(const Eigen::VectorXd &params, uint8_t r, uint8_t g, uint8_t b, pcl::PointCloud<pcl::PointXYZRGBA> &cloud);
+
+    private:
+        const std::vector<Eigen::Vector3f> &unitSurface(double e1, double e2);
+
+        int nEta_;
+        int nOmega_;
+        std::map<std::pair<int, int>, std::vector<Eigen::Vector3f>> cache_;
+    };
+}
+
+#endif
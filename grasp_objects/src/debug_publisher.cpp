@@ -0,0 +1,79 @@
+#include "grasp_objects/debug_publisher.hpp"
+
+#include <vector>
+
+namespace grasp_objects
+{
+    DebugPublisher::DebugPublisher() : thread_(&DebugPublisher::run, this)
+    {
+    }
+
+    DebugPublisher::~DebugPublisher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    bool DebugPublisher::wants(const std::string &topic)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = topics_.find(topic);
+        if (it == topics_.end() || it->second.publisher.getNumSubscribers() == 0)
+            return false;
+
+        ros::WallTime now = ros::WallTime::now();
+        if (now - it->second.last < it->second.minPeriod)
+            return false;
+        it->second.last = now;
+        return true;
+    }
+
+    void DebugPublisher::enqueue(const std::string &topic, std::function<void(ros::Publisher &)> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto it = topics_.find(topic);
+            if (it == topics_.end())
+                return;
+            // A newer product replaces the one still waiting
+            it->second.pending = std::move(job);
+        }
+        cv_.notify_one();
+    }
+
+    void DebugPublisher::run()
+    {
+        while (true)
+        {
+            std::vector<std::pair<ros::Publisher, std::function<void(ros::Publisher &)>>> jobs;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, [this]
+                         {
+                             if (stop_)
+                                 return true;
+                             for (const auto &topic : topics_)
+                                 if (topic.second.pending)
+                                     return true;
+                             return false;
+                         });
+                if (stop_)
+                    return;
+                for (auto &topic : topics_)
+                {
+                    if (topic.second.pending)
+                    {
+                        jobs.emplace_back(topic.second.publisher, std::move(topic.second.pending));
+                        topic.second.pending = nullptr;
+                    }
+                }
+            }
+            for (auto &job : jobs)
+                job.second(job.first);
+        }
+    }
+}
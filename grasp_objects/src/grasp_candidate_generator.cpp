@@ -0,0 +1,185 @@
+#include "grasp_objects/grasp_candidate_generator.hpp"
+
+#include <cmath>
+#include <numeric>
+
+#include <Eigen/Geometry>
+
+namespace grasp_objects
+{
+    namespace
+    {
+        // Grasps of a face are sampled at p0 + t * direction, with t in [-halfLength, halfLength]
+        struct Face
+        {
+            Eigen::Matrix3f rotation;
+            Eigen::Vector3f p0;
+            Eigen::Vector3f direction;
+            float halfLength;
+        };
+
+        Eigen::Matrix3f axesRotation(const Eigen::Vector3f &x, const Eigen::Vector3f &y, const Eigen::Vector3f &z)
+        {
+            Eigen::Matrix3f rot;
+            rot << x, y, z;
+            return rot;
+        }
+    }
+
+    void GraspCandidates::select(const std::vector<int> &indices)
+    {
+        for (size_t k = 0; k < indices.size(); k++)
+        {
+            positions.col(k) = positions.col(indices[k]);
+            orientations.col(k) = orientations.col(indices[k]);
+            approaches.col(k) = approaches.col(indices[k]);
+        }
+        positions.conservativeResize(Eigen::NoChange, indices.size());
+        orientations.conservativeResize(Eigen::NoChange, indices.size());
+        approaches.conservativeResize(Eigen::NoChange, indices.size());
+    }
+
+    GraspCandidateGenerator::GraspCandidateGenerator(float step, int faces, float maxObjectWidth)
+        : step_(step), faces_(faces), maxObjectWidth_(maxObjectWidth)
+    {
+        setMinApproachAngle(20 * M_PI / 180.0);
+    }
+
+    void GraspCandidateGenerator::setStep(float step)
+    {
+        if (step > 0)
+            step_ = step;
+    }
+
+    void GraspCandidateGenerator::setFaces(int faces)
+    {
+        faces_ = faces & GRASP_FACE_ALL;
+    }
+
+    bool GraspCandidateGenerator::setFaces(const std::vector<std::string> &faces)
+    {
+        int mask = 0;
+        for (const std::string &face : faces)
+        {
+            if (face == "x")
+                mask |= GRASP_FACE_X;
+            else if (face == "y")
+                mask |= GRASP_FACE_Y;
+            else if (face == "z")
+                mask |= GRASP_FACE_Z;
+        }
+        if (mask == 0)
+            return false;
+        faces_ = mask;
+        return true;
+    }
+
+    void GraspCandidateGenerator::setMinApproachAngle(float minApproachAngle)
+    {
+        cosMinApproachAngle_ = std::cos(minApproachAngle);
+    }
+
+    void GraspCandidateGenerator::generate(const Eigen::VectorXd &params, GraspCandidates &candidates) const
+    {
+        float a1 = params[0], a2 = params[1], a3 = params[2];
+        Eigen::Matrix3f objectRotation = (Eigen::AngleAxisf(params[8], Eigen::Vector3f::UnitZ()) *
+                                          Eigen::AngleAxisf(params[9], Eigen::Vector3f::UnitY()) *
+                                          Eigen::AngleAxisf(params[10], Eigen::Vector3f::UnitZ()))
+                                             .toRotationMatrix();
+        Eigen::Vector3f center(params[5], params[6], params[7]);
+
+        bool narrowZ = 2 * a3 <= maxObjectWidth_;
+        bool narrowY = 2 * a2 <= maxObjectWidth_;
+        Eigen::Matrix3f sideTCP = (Eigen::AngleAxisf(M_PI / 2.0, Eigen::Vector3f::UnitX()) *
+                                   Eigen::AngleAxisf(M_PI / 2.0, Eigen::Vector3f::UnitZ()))
+                                      .toRotationMatrix();
+        Eigen::Matrix3f frontTCP = Eigen::AngleAxisf(-M_PI / 2.0, Eigen::Vector3f::UnitX()).toRotationMatrix();
+
+        std::vector<Face> faces;
+        faces.reserve(6);
+        for (float s = -1.0; s <= 1.0; s += 2.0)
+        {
+            if ((faces_ & GRASP_FACE_Y) && narrowZ)
+            {
+                faces.push_back({sideTCP * axesRotation(Eigen::Vector3f(0, 0, -s), Eigen::Vector3f(0, s, 0), Eigen::Vector3f::UnitX()),
+                                 Eigen::Vector3f(0, -s * a2, 0), Eigen::Vector3f::UnitX(), a1 / 2.0f});
+            }
+            if ((faces_ & GRASP_FACE_X) && (narrowZ || narrowY))
+            {
+                faces.push_back({frontTCP * axesRotation(Eigen::Vector3f(s, 0, 0), Eigen::Vector3f(0, 0, -s), Eigen::Vector3f::UnitY()),
+                                 Eigen::Vector3f(-s * a1, 0, 0), Eigen::Vector3f::UnitY(), a2 / 2.0f});
+            }
+            if ((faces_ & GRASP_FACE_Z) && narrowY)
+            {
+                faces.push_back({sideTCP * axesRotation(Eigen::Vector3f(-s, 0, 0), Eigen::Vector3f(0, s, 0), -Eigen::Vector3f::UnitZ()),
+                                 Eigen::Vector3f(0, 0, s * a3), Eigen::Vector3f::UnitX(), a1 / 2.0f});
+            }
+        }
+
+        // Reject whole faces that approach from behind the object: angle between the grasp z axis and the base x axis
+        int nFaces = faces.size();
+        Eigen::Matrix3Xf faceRotations(3, 3 * nFaces);
+        for (int f = 0; f < nFaces; f++)
+        {
+            faceRotations.middleCols<3>(3 * f) = objectRotation * faces[f].rotation;
+        }
+        Eigen::Map<Eigen::Matrix3Xf, 0, Eigen::OuterStride<9>> faceApproaches(faceRotations.data() + 6, 3, nFaces);
+        Eigen::Array<bool, 1, Eigen::Dynamic> validFace = faceApproaches.row(0).array() < cosMinApproachAngle_;
+
+        // Candidate counts are known before any pose is built, t = 0 is sampled once per face
+        std::vector<int> nSteps(nFaces, 0);
+        int total = 0;
+        for (int f = 0; f < nFaces; f++)
+        {
+            if (!validFace[f])
+                continue;
+            nSteps[f] = (int)std::floor(faces[f].halfLength / step_ + 1e-4) + 1;
+            total += 2 * nSteps[f] - 1;
+        }
+
+        candidates.positions.resize(3, total);
+        candidates.orientations.resize(4, total);
+        candidates.approaches.resize(3, total);
+        int col = 0;
+        for (int f = 0; f < nFaces; f++)
+        {
+            if (!validFace[f])
+                continue;
+            int n = 2 * nSteps[f] - 1;
+            Eigen::RowVectorXf t = Eigen::RowVectorXf::LinSpaced(n, -(nSteps[f] - 1) * step_, (nSteps[f] - 1) * step_);
+            Eigen::Matrix3Xf local = faces[f].direction * t;
+            local.colwise() += faces[f].p0;
+            candidates.positions.middleCols(col, n) = local;
+
+            Eigen::Matrix3f rotation = faceRotations.middleCols<3>(3 * f);
+            candidates.orientations.middleCols(col, n) = Eigen::Quaternionf(rotation).coeffs().replicate(1, n);
+            candidates.approaches.middleCols(col, n) = rotation.col(0).replicate(1, n);
+            col += n;
+        }
+        candidates.positions = (objectRotation * candidates.positions).colwise() + center;
+    }
+
+    void GraspCandidateGenerator::toPoseArray(const GraspCandidates &candidates, geometry_msgs::PoseArray &poses)
+    {
+        std::vector<int> order(candidates.size());
+        std::iota(order.begin(), order.end(), 0);
+        toPoseArray(candidates, order, poses);
+    }
+
+    void GraspCandidateGenerator::toPoseArray(const GraspCandidates &candidates, const std::vector<int> &order, geometry_msgs::PoseArray &poses)
+    {
+        poses.poses.resize(order.size());
+        for (size_t k = 0; k < order.size(); k++)
+        {
+            int i = order[k];
+            geometry_msgs::Pose &pose = poses.poses[k];
+            pose.position.x = candidates.positions(0, i);
+            pose.position.y = candidates.positions(1, i);
+            pose.position.z = candidates.positions(2, i);
+            pose.orientation.x = candidates.orientations(0, i);
+            pose.orientation.y = candidates.orientations(1, i);
+            pose.orientation.z = candidates.orientations(2, i);
+            pose.orientation.w = candidates.orientations(3, i);
+        }
+    }
+}
@@ -1,8 +1,68 @@
 #include "grasp_objects/grasp_objects.hpp"
 
+#include <chrono>
+
+#include <ros/package.h>
+
+#include <boost/make_shared.hpp>
+
 namespace grasp_objects
 {
-    GraspObjects::GraspObjects(ros::NodeHandle nh) : nodeHandle_(nh)
+    namespace
+    {
+        /** Runs a function from a callback queue, so it is serialized with the other callbacks of that queue. */
+        class FunctionCallback : public ros::CallbackInterface
+        {
+        public:
+            explicit FunctionCallback(const boost::function<void()> &function) : function_(function) {}
+
+            CallResult call() override
+            {
+                function_();
+                return Success;
+            }
+
+        private:
+            boost::function<void()> function_;
+        };
+
+        /** @return rotation of the ZYZ angles of superquadric parameters a1, a2, a3, e1, e2, x, y, z, roll, pitch, yaw. */
+        Eigen::Matrix3d superquadricRotation(const Eigen::VectorXd &params)
+        {
+            return (Eigen::AngleAxisd(params[8], Eigen::Vector3d::UnitZ()) * Eigen::AngleAxisd(params[9], Eigen::Vector3d::UnitY()) *
+                    Eigen::AngleAxisd(params[10], Eigen::Vector3d::UnitZ()))
+                .toRotationMatrix();
+        }
+
+        bool similarSuperquadric(const Eigen::VectorXd &a, const Eigen::VectorXd &b, const GraspCacheTolerances &tolerances)
+        {
+            if ((a.segment<3>(5) - b.segment<3>(5)).norm() > tolerances.position ||
+                (a.head<3>() - b.head<3>()).cwiseAbs().maxCoeff() > tolerances.size ||
+                (a.segment<2>(3) - b.segment<2>(3)).cwiseAbs().maxCoeff() > tolerances.exponent)
+                return false;
+            // Comparing the angles themselves breaks near the ZYZ singularity, where very different angles give the same rotation
+            Eigen::AngleAxisd relative(superquadricRotation(a).transpose() * superquadricRotation(b));
+            return std::abs(relative.angle()) <= tolerances.orientation;
+        }
+
+        bool similarSuperquadrics(const std::vector<Eigen::VectorXd> &a, const std::vector<Eigen::VectorXd> &b, const GraspCacheTolerances &tolerances)
+        {
+            if (a.size() != b.size())
+                return false;
+            for (size_t i = 0; i < a.size(); i++)
+                if (!similarSuperquadric(a[i], b[i], tolerances))
+                    return false;
+            return true;
+        }
+
+        bool similarPlane(const Eigen::Vector4f &a, const Eigen::Vector4f &b, const GraspCacheTolerances &tolerances)
+        {
+            float cosAngle = a.head<3>().normalized().dot(b.head<3>().normalized());
+            return std::acos(std::min(cosAngle, 1.0f)) <= tolerances.orientation && std::abs(a[3] - b[3]) <= tolerances.position;
+        }
+    }
+
+    GraspObjects::GraspObjects(ros::NodeHandle nh) : nodeHandle_(nh), scene_(std::make_shared<SceneSnapshot>())
     {
         ROS_INFO("[GraspObjects] Node started.");
         init();
@@ -10,12 +70,31 @@ namespace grasp_objects
 
     GraspObjects::~GraspObjects()
     {
+        if (perceptionSpinner_)
+            perceptionSpinner_->stop();
+        {
+            std::lock_guard<std::mutex> lock(mtxComputeScene_);
+            stopComputeScene_ = true;
+        }
+        cvComputeScene_.notify_all();
+        // The stages report to the action server, and a goal still running ends through it, so it is only destroyed once both are done
+        pipeline_.stop();
+        if (computeSceneServer_)
+            computeSceneServer_->shutdown();
+        computeSceneServer_.reset();
+        {
+            std::lock_guard<std::mutex> lock(mtxGraspCache_);
+            stopGraspThread_ = true;
+        }
+        cvGraspCache_.notify_all();
+        if (graspThread_.joinable())
+            graspThread_.join();
     }
 
     void GraspObjects::init()
     {
         ROS_INFO("[GraspObjects] init().");
-        std::string pointCloudTopicName, cameraInfoTopicName, compressedDepthImageTopicName;
+        std::string pointCloudTopicName, cameraInfoTopicName;
         ros::param::get("grasp_objects/eps_angle", epsAnglePlaneSegmentation_);
         ros::param::get("grasp_objects/distance_threshold", distanceThresholdPlaneSegmentation_);
         ros::param::get("grasp_objects/tol_superq", tolSuperq_);
@@ -31,13 +110,50 @@ namespace grasp_objects
         ros::param::get("grasp_objects/single_superq", single_superq_);
         ros::param::get("grasp_objects/merge_model", merge_model_);
         ros::param::get("grasp_objects/th_points", th_points_);
+        ros::param::get("grasp_objects/stratified_subsampling", stratifiedSubsampling_);
+        ros::param::get("grasp_objects/subsample_points", subsamplePoints_);
+        ros::param::get("grasp_objects/completion_voxel_size", completionVoxelSize_);
+        ros::param::get("grasp_objects/completion_distance_top", completionDistanceTop_);
+        ros::param::get("grasp_objects/completion_max_points", completionMaxPoints_);
+        ros::param::get("grasp_objects/default_table_height", defaultTableHeight_);
+        ros::param::get("grasp_objects/visualization_points", visualizationPoints_);
+        ros::param::get("grasp_objects/bbox_source", bboxSource_);
+        ros::param::get("grasp_objects/label_voxel_size", labelVoxelSize_);
+        ros::param::get("grasp_objects/segmentation_output", segmentationOutput_);
+        float graspSamplingStep = 0.025;
+        ros::param::get("grasp_objects/grasp_sampling_step", graspSamplingStep);
+        graspGenerator_.setStep(graspSamplingStep);
+        std::vector<std::string> graspFaces;
+        if (ros::param::get("grasp_objects/grasp_faces", graspFaces) && !graspGenerator_.setFaces(graspFaces))
+        {
+            ROS_WARN("[GraspObjects] grasp_objects/grasp_faces has no valid face, sampling all of them");
+        }
+        surfaceSampler_.setNumberPoints(visualizationPoints_);
+        ros::param::get("grasp_objects/max_fit_time", maxFitTime_);
+        ros::param::get("grasp_objects/category_association_radius", categoryAssociationRadius_);
+        loadSuperquadricPriors();
+        loadGraspScoringParams();
+        loadSceneStabilityParams();
+        loadGripperCollisionParams();
+        ros::param::get("grasp_objects/grasp_cache_tolerance/position", graspCacheTolerances_.position);
+        ros::param::get("grasp_objects/grasp_cache_tolerance/size", graspCacheTolerances_.size);
+        ros::param::get("grasp_objects/grasp_cache_tolerance/exponent", graspCacheTolerances_.exponent);
+        ros::param::get("grasp_objects/grasp_cache_tolerance/orientation", graspCacheTolerances_.orientation);
+        ros::param::get("grasp_objects/grasp_cache_timeout", graspCacheTimeout_);
+        double pipelineMetricsPeriod = 1.0;
+        ros::param::get("grasp_objects/pipeline/queue_capacity", pipelineQueueCapacity_);
+        ros::param::get("grasp_objects/pipeline/metrics_period", pipelineMetricsPeriod);
 
         nodeHandle_.param("subscribers/point_cloud/topic", pointCloudTopicName, std::string("/xtion/depth/points"));
         nodeHandle_.param("subscribers/camera_info/topic", cameraInfoTopicName, std::string("/xtion/rgb/camera_info"));
         // nodeHandle_.param("subscribers/compressed_depth_image/topic", compressedDepthImageTopicName, std::string("/xtion/depth/image_rect"));
-        nodeHandle_.param("subscribers/compressed_depth_image/topic", compressedDepthImageTopicName, std::string("/xtion/depth_registered/image_raw"));
+        nodeHandle_.param("subscribers/compressed_depth_image/topic", compressedDepthImageTopicName_, std::string("/xtion/depth_registered/image_raw"));
 
         image_transport::ImageTransport it(nodeHandle_);
+        // Depth images get their own queue and thread, the services stay on the global queue
+        perceptionNodeHandle_ = nodeHandle_;
+        perceptionNodeHandle_.setCallbackQueue(&perceptionQueue_);
+        perceptionIt_.reset(new image_transport::ImageTransport(perceptionNodeHandle_));
         ROS_INFO("[GraspObjects] grasp_objects/eps_angle set to %f", epsAnglePlaneSegmentation_);
         ROS_INFO("[GraspObjects] grasp_objects/distance_threshold set to %f", distanceThresholdPlaneSegmentation_);
         ROS_INFO("[GraspObjects] grasp_objects/tol_superq set to %f", tolSuperq_);
@@ -53,6 +169,20 @@ namespace grasp_objects
         ROS_INFO("[GraspObjects] grasp_objects/single_superq set to %d", single_superq_);
         ROS_INFO("[GraspObjects] grasp_objects/merge_model set to %d", merge_model_);
         ROS_INFO("[GraspObjects] grasp_objects/th_points set to %d", th_points_);
+        ROS_INFO("[GraspObjects] grasp_objects/stratified_subsampling set to %d", stratifiedSubsampling_);
+        ROS_INFO("[GraspObjects] grasp_objects/subsample_points set to %d", subsamplePoints_);
+        ROS_INFO("[GraspObjects] grasp_objects/completion_voxel_size set to %f", completionVoxelSize_);
+        ROS_INFO("[GraspObjects] grasp_objects/completion_distance_top set to %f", completionDistanceTop_);
+        ROS_INFO("[GraspObjects] grasp_objects/completion_max_points set to %d", completionMaxPoints_);
+        ROS_INFO("[GraspObjects] grasp_objects/default_table_height set to %f", defaultTableHeight_);
+        ROS_INFO("[GraspObjects] grasp_objects/visualization_points set to %d", visualizationPoints_);
+        ROS_INFO("[GraspObjects] grasp_objects/bbox_source set to %s", bboxSource_.c_str());
+        ROS_INFO("[GraspObjects] grasp_objects/label_voxel_size set to %f", labelVoxelSize_);
+        ROS_INFO("[GraspObjects] grasp_objects/segmentation_output set to %s", segmentationOutput_.c_str());
+        ROS_INFO("[GraspObjects] grasp_objects/grasp_sampling_step set to %f", graspSamplingStep);
+        ROS_INFO("[GraspObjects] grasp_objects/max_fit_time set to %f", maxFitTime_);
+        ROS_INFO("[GraspObjects] grasp_objects/category_association_radius set to %f", categoryAssociationRadius_);
+        ROS_INFO("[GraspObjects] grasp_objects/pipeline/queue_capacity set to %d", pipelineQueueCapacity_);
         ROS_INFO("[GraspObjects] subscribers/point_cloud/topic set to %s", pointCloudTopicName.c_str());
         ROS_INFO("[GraspObjects] subscribers/camera_info/topic set to %s", cameraInfoTopicName.c_str());
 
@@ -68,6 +198,9 @@ namespace grasp_objects
         estim_.SetNumericValue("threshold_axis", thresholdAxis_);
         estim_.SetNumericValue("threshold_section1", thresholdSection1_);
         estim_.SetNumericValue("threshold_section2", thresholdSection2_);
+        // Ipopt stops at this wall time and returns its best iterate, so one bad segment cannot stall the frame.
+        // Its cpu time limit counts the cpu time of the whole process, which the other threads of the node also use.
+        estim_.SetNumericValue("max_wall_time", maxFitTime_);
 
         ROS_INFO("[GraspObjects] Waiting to get the camera info...");
         sensor_msgs::CameraInfoConstPtr cameraInfoMsg = ros::topic::waitForMessage<sensor_msgs::CameraInfo>(cameraInfoTopicName);
@@ -77,195 +210,332 @@ namespace grasp_objects
 
         // pointCloudSubscriber_ = nodeHandle_.subscribe(pointCloudTopicName, 20, &GraspObjects::pointCloudCallback, this);
         // compressedDepthImageSubscriber_ = it.subscribe(compressedDepthImageTopicName, 10, &GraspObjects::compressedDepthImageCallback, this, image_transport::TransportHints("compressedDepth"));
+        // The depth images are only subscribed while the computation is activated, see setActivation()
+
+        double rateTransformedCloud, rateAddedPoints, rateSuperquadricsCloud, rateBbox3d;
+        ros::param::param("grasp_objects/debug_publish_rates/transformed_cloud", rateTransformedCloud, 2.0);
+        ros::param::param("grasp_objects/debug_publish_rates/added_points", rateAddedPoints, 1.0);
+        ros::param::param("grasp_objects/debug_publish_rates/superquadrics_cloud", rateSuperquadricsCloud, 2.0);
+        ros::param::param("grasp_objects/debug_publish_rates/bbox3d", rateBbox3d, 2.0);
+        debugPublisher_.advertise<sensor_msgs::PointCloud2>(nodeHandle_, "/transformed_cloud", rateTransformedCloud);
+        debugPublisher_.advertise<sensor_msgs::PointCloud2>(nodeHandle_, "/added_points", rateAddedPoints);
+        debugPublisher_.advertise<sensor_msgs::PointCloud2>(nodeHandle_, "/grasp_objects/superquadrics_cloud", rateSuperquadricsCloud);
+        debugPublisher_.advertise<visualization_msgs::MarkerArray>(nodeHandle_, "/grasp_objects/bbox3d", rateBbox3d);
 
-        compressedDepthImageSubscriber_ = it.subscribe(compressedDepthImageTopicName, 10, &GraspObjects::compressedDepthImageCallback, this, image_transport::TransportHints("raw"));
-
-        outPointCloudPublisher_ = nodeHandle_.advertise<sensor_msgs::PointCloud2>("/transformed_cloud", 20);
-        outPointCloudAddedPointsPublisher_ = nodeHandle_.advertise<sensor_msgs::PointCloud2>("/added_points", 20);
-        outPointCloudSuperqsPublisher_ = nodeHandle_.advertise<sensor_msgs::PointCloud2>("/grasp_objects/superquadrics_cloud", 20);
         superquadricsPublisher_ = nodeHandle_.advertise<sharon_msgs::SuperquadricMultiArray>("/grasp_objects/superquadrics", 20);
         graspPosesPublisher_ = nodeHandle_.advertise<geometry_msgs::PoseArray>("/grasp_objects/poses", 20);
-        bbox3dPublisher_ = nodeHandle_.advertise<visualization_msgs::MarkerArray>("/grasp_objects/bbox3d", 20);
+        boundingBoxesPublisher_ = nodeHandle_.advertise<sharon_msgs::BoundingBoxes>("/grasp_objects/bounding_boxes", 1, true);
+        if (segmentationOutput_ != "cloud")
+        {
+            labelImagePublisher_ = it.advertise("/grasp_objects/label_image", 1);
+        }
+
+        graspThread_ = std::thread(&GraspObjects::graspPrecomputationThread, this);
+
+        // Each stage works on its own thread, so the next frame is filtered and segmented while the current one is fitted
+        pipeline_.addStage("ingest", [this](std::unique_ptr<PerceptionFrame> &frame)
+                           { return ingestFrame(*frame); });
+        pipeline_.addStage("filter", [this](std::unique_ptr<PerceptionFrame> &frame)
+                           { return filterFrame(*frame); });
+        pipeline_.addStage("segmentation", [this](std::unique_ptr<PerceptionFrame> &frame)
+                           { return segmentFrame(*frame); });
+        pipeline_.addStage("fitting", [this](std::unique_ptr<PerceptionFrame> &frame)
+                           { return fitFrame(*frame); });
+        pipeline_.addStage("publish", [this](std::unique_ptr<PerceptionFrame> &frame)
+                           { return publishFrame(*frame); });
+        pipeline_.setObserver([this](const std::string &stage, const std::unique_ptr<PerceptionFrame> &frame)
+                              { reportStage(stage, *frame); });
+        pipeline_.start(pipelineQueueCapacity_);
+        pipelineMetricsPublisher_ = nodeHandle_.advertise<sharon_msgs::PipelineMetrics>("/grasp_objects/pipeline_metrics", 1);
+        sceneStabilityPublisher_ = nodeHandle_.advertise<sharon_msgs::SceneStability>("/grasp_objects/scene_stability", 1, true);
+        sceneStabilityPublisher_.publish(sharon_msgs::SceneStability());
+        if (pipelineMetricsPeriod > 0)
+        {
+            pipelineMetricsTimer_ = nodeHandle_.createWallTimer(ros::WallDuration(pipelineMetricsPeriod), &GraspObjects::publishPipelineMetrics, this);
+        }
 
         serviceActivateSuperquadricsComputation_ = nodeHandle_.advertiseService("/grasp_objects/activate_superquadrics_computation", &GraspObjects::activateSuperquadricsComputation, this);
         serviceComputeGraspPoses_ = nodeHandle_.advertiseService("/grasp_objects/compute_grasp_poses", &GraspObjects::computeGraspPoses, this);
+        serviceComputeGraspPosesBatch_ = nodeHandle_.advertiseService("/grasp_objects/compute_grasp_poses_batch", &GraspObjects::computeGraspPosesBatch, this);
         serviceGetSuperquadrics_ = nodeHandle_.advertiseService("/grasp_objects/get_superquadrics", &GraspObjects::getSuperquadrics, this);
         serviceGetBboxesSuperquadrics_ = nodeHandle_.advertiseService("/grasp_objects/get_bboxes_superquadrics", &GraspObjects::getBboxes, this);
+        serviceSetObjectCategories_ = nodeHandle_.advertiseService("/grasp_objects/set_object_categories", &GraspObjects::setObjectCategories, this);
+        computeSceneServer_.reset(new actionlib::SimpleActionServer<sharon_msgs::ComputeSceneAction>(nodeHandle_, "/grasp_objects/compute_scene",
+                                                                                                    boost::bind(&GraspObjects::computeScene, this, _1), false));
+        computeSceneServer_->start();
+
+        perceptionSpinner_.reset(new ros::AsyncSpinner(1, &perceptionQueue_));
+        perceptionSpinner_->start();
     }
 
-    bool GraspObjects::createBoundingBox2DFromSuperquadric(const sharon_msgs::Superquadric &superq, sharon_msgs::BoundingBox &bbox)
+    void GraspObjects::loadSuperquadricPriors()
     {
-        // Bbox 3d wrt object's frame
-
-        pcl::PointCloud<pcl::PointXYZ>::Ptr bbox3d(new pcl::PointCloud<pcl::PointXYZ>);
-        for (float x = -1; x <= 1; x += 2)
+        std::string modelsPath;
+        ros::param::get("grasp_objects/superquadric_priors/models_path", modelsPath);
+        if (modelsPath.empty())
+            modelsPath = ros::package::getPath("sharon_objects") + "/models";
+        double axisTolerance = 0.3;
+        ros::param::get("grasp_objects/superquadric_priors/axis_tolerance", axisTolerance);
+
+        std::vector<std::string> categories;
+        ros::param::get("grasp_objects/superquadric_priors/categories", categories);
+        XmlRpc::XmlRpcValue exponents;
+        ros::param::get("grasp_objects/superquadric_priors/exponents", exponents);
+
+        std::vector<ModelShape> shapes;
+        readModelShapes(modelsPath, shapes);
+        for (const ModelShape &shape : shapes)
         {
-            for (float y = -1; y <= 1; y += 2)
+            // The models directory also holds the scene (kitchen, tables), which are not detected objects
+            std::string category = modelCategory(shape.name);
+            if (std::find(categories.begin(), categories.end(), category) == categories.end())
+                continue;
+            if (exponents.getType() != XmlRpc::XmlRpcValue::TypeStruct || !exponents.hasMember(shape.objectClass))
+            {
+                ROS_WARN("[GraspObjects] No exponent ranges for object_class %s, skipping model %s.", shape.objectClass.c_str(), shape.name.c_str());
+                continue;
+            }
+            XmlRpc::XmlRpcValue &range = exponents[shape.objectClass];
+            SuperquadricPrior prior;
+            prior.objectClass = shape.objectClass;
+            for (int i = 0; i < 3; i++)
             {
-                for (float z = -1; z <= 1; z += 2)
+                prior.minAxes[i] = shape.semiAxes[i] * (1.0 - axisTolerance);
+                prior.maxAxes[i] = shape.semiAxes[i] * (1.0 + axisTolerance);
+            }
+            prior.minE1 = static_cast<double>(range["e1"][0]);
+            prior.maxE1 = static_cast<double>(range["e1"][1]);
+            prior.minE2 = static_cast<double>(range["e2"][0]);
+            prior.maxE2 = static_cast<double>(range["e2"][1]);
+
+            // Variants of a category (milk1, milk2) share a prior covering all of them
+            auto it = priors_.find(category);
+            if (it == priors_.end())
+            {
+                priors_[category] = prior;
+            }
+            else if (it->second.objectClass == prior.objectClass)
+            {
+                for (int i = 0; i < 3; i++)
                 {
-                    pcl::PointXYZ p;
+                    it->second.minAxes[i] = std::min(it->second.minAxes[i], prior.minAxes[i]);
+                    it->second.maxAxes[i] = std::max(it->second.maxAxes[i], prior.maxAxes[i]);
+                }
+            }
+            else
+            {
+                ROS_WARN("[GraspObjects] Model %s is a %s but other %s models are not, skipping it.", shape.name.c_str(), shape.objectClass.c_str(), category.c_str());
+            }
+        }
 
-                    p.x = x * superq.a1;
-                    p.y = y * superq.a2;
-                    p.z = z * superq.a3;
+        if (priors_.empty())
+            ROS_INFO("[GraspObjects] No superquadric priors loaded from %s.", modelsPath.c_str());
+        for (const auto &prior : priors_)
+        {
+            ROS_INFO("[GraspObjects] Superquadric prior for %s with object_class %s, semi-axes [%.3f %.3f %.3f]-[%.3f %.3f %.3f]",
+                     prior.first.c_str(), prior.second.objectClass.c_str(), prior.second.minAxes[0], prior.second.minAxes[1], prior.second.minAxes[2],
+                     prior.second.maxAxes[0], prior.second.maxAxes[1], prior.second.maxAxes[2]);
+        }
+    }
 
-                    bbox3d->push_back(*(pcl::PointXYZ *)(&p));
+    bool GraspObjects::setObjectCategories(sharon_msgs::SetObjectCategories::Request &req, sharon_msgs::SetObjectCategories::Response &res)
+    {
+        ROS_INFO("[GraspObjects] setObjectCategories().");
+        std::shared_ptr<const SceneSnapshot> scene = sceneSnapshot();
+        std::lock_guard<std::mutex> lock(mtxCategories_);
+        categorizedObjects_.clear();
+        for (int i = 0; i < req.ids.size() && i < req.categories.size(); i++)
+        {
+            for (int j = 0; j < scene->superquadrics.superquadrics.size(); j++)
+            {
+                const sharon_msgs::Superquadric &superq = scene->superquadrics.superquadrics[j];
+                if (superq.id == req.ids[i])
+                {
+                    CategorizedObject categorizedObject;
+                    categorizedObject.category = req.categories[i];
+                    categorizedObject.centroid = Eigen::Vector3f(superq.x, superq.y, superq.z);
+                    categorizedObjects_.push_back(categorizedObject);
+                    ROS_INFO("[GraspObjects] Object %d is a %s", superq.id, req.categories[i].c_str());
                 }
             }
         }
+        res.success = true;
+        return true;
+    }
 
-        // Bbox 3d wrt world frame
-        Eigen::AngleAxisf rollAngle(superq.roll, Eigen::Vector3f::UnitZ());
-        Eigen::AngleAxisf yawAngle(superq.pitch, Eigen::Vector3f::UnitY());
-        Eigen::AngleAxisf pitchAngle(superq.yaw, Eigen::Vector3f::UnitZ());
+    const SuperquadricPrior *GraspObjects::findPrior(const pcl::PointCloud<pcl::PointXYZRGB> &object_cloud)
+    {
+        std::lock_guard<std::mutex> lock(mtxCategories_);
+        if (categorizedObjects_.empty() || priors_.empty())
+            return nullptr;
 
-        Eigen::Quaternionf q = rollAngle * yawAngle * pitchAngle;
-        Eigen::Matrix3f rotationMatrix = q.matrix();
+        // Segment labels change between frames, so segments are matched to categorized objects by their position on the table
+        Eigen::Vector4f centroid;
+        pcl::compute3DCentroid(object_cloud, centroid);
 
-        Eigen::Vector3f v(superq.x, superq.y, superq.z);
-        Eigen::Matrix4f transform = Eigen::Affine3f(Eigen::Translation3f(v)).matrix();
+        const CategorizedObject *closest = nullptr;
+        float minDistance = categoryAssociationRadius_;
+        for (const CategorizedObject &categorizedObject : categorizedObjects_)
+        {
+            float distance = (categorizedObject.centroid.head<2>() - centroid.head<2>()).norm();
+            if (distance <= minDistance)
+            {
+                minDistance = distance;
+                closest = &categorizedObject;
+            }
+        }
+        if (closest == nullptr)
+            return nullptr;
 
-        transform.block<3, 3>(0, 0) = rotationMatrix;
-        pcl::transformPointCloud(*bbox3d, *bbox3d, transform);
+        auto it = priors_.find(closest->category);
+        return it != priors_.end() ? &it->second : nullptr;
+    }
 
-        Eigen::Matrix4f outMatrixTransform;
-        pcl_ros::transformAsMatrix(transformCameraWrtBase_, outMatrixTransform);
+    bool GraspObjects::isPlausibleSuperquadric(const SuperquadricPrior &prior, const SuperqModel::Superquadric &superq)
+    {
+        auto params = superq.getSuperqParams();
+        std::array<float, 3> axes = {(float)params[0], (float)params[1], (float)params[2]};
+        std::sort(axes.begin(), axes.end());
+        for (int i = 0; i < 3; i++)
+        {
+            if (axes[i] < prior.minAxes[i] || axes[i] > prior.maxAxes[i])
+                return false;
+        }
+        return params[3] >= prior.minE1 && params[3] <= prior.maxE1 && params[4] >= prior.minE2 && params[4] <= prior.maxE2;
+    }
 
-        pcl::transformPointCloud(*bbox3d, *bbox3d, outMatrixTransform.inverse());
+    void GraspObjects::computeBoundingBoxes2D(const sharon_msgs::SuperquadricMultiArray &superquadrics, const Eigen::Matrix4f &cameraFromBase,
+                                              sharon_msgs::BoundingBoxes &boundingBoxes,
+                                              visualization_msgs::MarkerArray *markerArray)
+    {
+        // Bbox corners wrt object's frame, in the order x, y, z from -1 to 1
+        static const Eigen::Matrix<float, 3, 8> unitCorners = (Eigen::Matrix<float, 3, 8>() << -1, -1, -1, -1, 1, 1, 1, 1,
+                                                               -1, -1, 1, 1, -1, -1, 1, 1,
+                                                               -1, 1, -1, 1, -1, 1, -1, 1)
+                                                                  .finished();
+        static const int edges[12][2] = {{0, 1}, {2, 3}, {4, 5}, {6, 7}, {0, 2}, {1, 3}, {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
+        const int n = superquadrics.superquadrics.size();
+        Eigen::Matrix3Xf corners(3, 8 * n);
+        const Eigen::Matrix3f rotationCamera = cameraFromBase.block<3, 3>(0, 0);
+        const Eigen::Vector3f translationCamera = cameraFromBase.block<3, 1>(0, 3);
+
+        // Bbox 3d wrt camera frame
+        for (int i = 0; i < n; i++)
+        {
+            const sharon_msgs::Superquadric &superq = superquadrics.superquadrics[i];
+            Eigen::AngleAxisf rollAngle(superq.roll, Eigen::Vector3f::UnitZ());
+            Eigen::AngleAxisf yawAngle(superq.pitch, Eigen::Vector3f::UnitY());
+            Eigen::AngleAxisf pitchAngle(superq.yaw, Eigen::Vector3f::UnitZ());
+            Eigen::Quaternionf q = rollAngle * yawAngle * pitchAngle;
+
+            Eigen::Matrix3f linear = rotationCamera * q.matrix() * Eigen::Vector3f(superq.a1, superq.a2, superq.a3).asDiagonal();
+            Eigen::Vector3f center = rotationCamera * Eigen::Vector3f(superq.x, superq.y, superq.z) + translationCamera;
+            corners.middleCols<8>(8 * i) = (linear * unitCorners).colwise() + center;
+        }
 
-        visualization_msgs::MarkerArray markerArray;
-        visualization_msgs::Marker marker;
+        // Pinhole projection of all the corners at once
+        Eigen::ArrayXXi pixels(2, 8 * n);
+        pixels.row(0) = (corners.row(0).array() * focalLengthX_ / corners.row(2).array() + principalPointX_).cast<int>().max(0).min(width_);
+        pixels.row(1) = (corners.row(1).array() * focalLengthY_ / corners.row(2).array() + principalPointY_).cast<int>().max(0).min(height_);
 
-        marker.type = visualization_msgs::Marker::LINE_LIST;
-        marker.action = visualization_msgs::Marker::ADD;
-        marker.header.frame_id = "xtion_depth_optical_frame";
-        marker.header.stamp = ros::Time::now();
+        boundingBoxes.bounding_boxes.resize(n);
+        for (int i = 0; i < n; i++)
+        {
+            sharon_msgs::BoundingBox &bbox = boundingBoxes.bounding_boxes[i];
+            auto objectPixels = pixels.middleCols<8>(8 * i);
+            bbox.id = superquadrics.superquadrics[i].id;
+            bbox.tlx = objectPixels.row(0).minCoeff();
+            bbox.tly = objectPixels.row(1).minCoeff();
+            bbox.brx = objectPixels.row(0).maxCoeff();
+            bbox.bry = objectPixels.row(1).maxCoeff();
+        }
 
-        ROS_INFO("Bbox has %d points", bbox3d->points.size());
-        for (int idx = 0; idx <= bbox3d->points.size() - 1; idx += 1)
+        if (markerArray != nullptr)
         {
-            if (idx % 2 == 0)
+            for (int i = 0; i < n; i++)
             {
-                // marker.id = idx;
-                ROS_INFO("Line %d and %d", idx, idx + 1);
-                geometry_msgs::Point pointRos;
-                pointRos.x = bbox3d->points[idx].x;
-                pointRos.y = bbox3d->points[idx].y;
-                pointRos.z = bbox3d->points[idx].z;
-                marker.points.push_back(pointRos);
-
-                pointRos.x = bbox3d->points[idx + 1].x;
-                pointRos.y = bbox3d->points[idx + 1].y;
-                pointRos.z = bbox3d->points[idx + 1].z;
-                marker.points.push_back(pointRos);
-
+                visualization_msgs::Marker marker;
+                marker.type = visualization_msgs::Marker::LINE_LIST;
+                marker.action = visualization_msgs::Marker::ADD;
+                marker.header.frame_id = "xtion_depth_optical_frame";
+                marker.header.stamp = ros::Time::now();
+                marker.id = i;
                 marker.pose.orientation.w = 1.0;
+                marker.points.reserve(24);
+                for (const auto &edge : edges)
+                {
+                    for (int k = 0; k < 2; k++)
+                    {
+                        geometry_msgs::Point pointRos;
+                        pointRos.x = corners(0, 8 * i + edge[k]);
+                        pointRos.y = corners(1, 8 * i + edge[k]);
+                        pointRos.z = corners(2, 8 * i + edge[k]);
+                        marker.points.push_back(pointRos);
+                    }
+                }
+                marker.scale.x = 0.005;
+                marker.color.a = 1.0; // Don't forget to set the alpha!
+                marker.color.b = 1.0;
+                markerArray->markers.push_back(marker);
             }
-            if (idx <= 1 || ((idx >= 4) && (idx < 6)))
-            {
-                geometry_msgs::Point pointRos;
-                pointRos.x = bbox3d->points[idx].x;
-                pointRos.y = bbox3d->points[idx].y;
-                pointRos.z = bbox3d->points[idx].z;
-                marker.points.push_back(pointRos);
-
-                pointRos.x = bbox3d->points[idx + 2].x;
-                pointRos.y = bbox3d->points[idx + 2].y;
-                pointRos.z = bbox3d->points[idx + 2].z;
-                marker.points.push_back(pointRos);
+        }
+    }
 
-                marker.pose.orientation.w = 1.0;
-            }
-            if (idx <= 3)
-            {
-                geometry_msgs::Point pointRos;
+    void GraspObjects::buildFrameLabelImage(PerceptionFrame &frame)
+    {
+        CameraIntrinsics intrinsics = {width_, height_, focalLengthX_, focalLengthY_, principalPointX_, principalPointY_};
+        cv::Mat depth;
+        try
+        {
+            depth = cv_bridge::toCvShare(frame.depth)->image;
+        }
+        catch (const cv_bridge::Exception &ex)
+        {
+            ROS_WARN("[GraspObjects] %s", ex.what());
+        }
+        buildLabelImage(*frame.labeledCloud, depth, frame.cameraFromBase, intrinsics, labelVoxelSize_, frame.labelImage);
+    }
 
-                pointRos.x = bbox3d->points[idx].x;
-                pointRos.y = bbox3d->points[idx].y;
-                pointRos.z = bbox3d->points[idx].z;
-                marker.points.push_back(pointRos);
+    void GraspObjects::computeBoundingBoxesFromLabels(PerceptionFrame &frame, sharon_msgs::BoundingBoxes &boundingBoxes)
+    {
+        buildFrameLabelImage(frame);
 
-                pointRos.x = bbox3d->points[idx + 4].x;
-                pointRos.y = bbox3d->points[idx + 4].y;
-                pointRos.z = bbox3d->points[idx + 4].z;
-                marker.points.push_back(pointRos);
+        std::map<uint16_t, LabelBox> labelBoxes;
+        computeLabelBoxes(frame.labelImage, labelBoxes);
 
-                marker.pose.orientation.w = 1.0;
-            }
-        }
-        marker.scale.x = 0.005;
-        marker.color.a = 1.0; // Don't forget to set the alpha!
-        marker.color.r = 0.0;
-        marker.color.g = 0.0;
-        marker.color.b = 1.0;
-        markerArray.markers.push_back(marker);
-
-        bbox3dPublisher_.publish(markerArray);
-
-        int tlx1 = width_, tly1 = height_, brx1 = 0, bry1 = 0;
-        for (size_t idx = 0; idx < bbox3d->size(); idx++)
-        {
-            pcl::PointXYZ p(bbox3d->points[idx].x, bbox3d->points[idx].y, bbox3d->points[idx].z);
-            int xpixel, ypixel;
-            // yInfo()<<"xpixel: "<<xpixel<<" ypixel: "<<ypixel;
-            getPixelCoordinates(p, xpixel, ypixel);
-            if (xpixel < tlx1)
-            {
-                tlx1 = xpixel;
-            }
-            if (xpixel > brx1)
-            {
-                brx1 = xpixel;
-            }
-            if (ypixel < tly1)
-            {
-                tly1 = ypixel;
-            }
-            if (ypixel > bry1)
-            {
-                bry1 = ypixel;
-            }
+        boundingBoxes.bounding_boxes.clear();
+        for (const Object &object : frame.objects)
+        {
+            auto it = labelBoxes.find(object.label);
+            if (it == labelBoxes.end())
+                continue;
+            sharon_msgs::BoundingBox bbox;
+            bbox.id = object.label;
+            bbox.tlx = it->second.tlx;
+            bbox.tly = it->second.tly;
+            bbox.brx = it->second.brx;
+            bbox.bry = it->second.bry;
+            bbox.pixel_count = it->second.pixelCount;
+            boundingBoxes.bounding_boxes.push_back(bbox);
         }
-        bbox.tlx = tlx1;
-        bbox.tly = tly1;
-        bbox.brx = brx1;
-        bbox.bry = bry1;
-        bbox.id = superq.id;
-
-        return true;
     }
 
-    void GraspObjects::getPixelCoordinates(const pcl::PointXYZ &p, int &xpixel, int &ypixel)
+    void GraspObjects::publishLabelImage(PerceptionFrame &frame, bool labelImageUpToDate)
     {
-        ROS_INFO("p: %f %f %f ", p.x, p.y, p.z);
-        // yInfo() << "intrinsics.focalLengthX:" << intrinsics.focalLengthX << " intrinsics.principalPointX: " << intrinsics.principalPointX;
-        // yInfo() << "intrinsics.focalLengthY:" << intrinsics.focalLengthY << " intrinsics.principalPointY: " << intrinsics.principalPointY;
-
-        ROS_INFO("focalLengthX_: %f principalPointX_: %f", focalLengthX_, principalPointX_);
-        ROS_INFO("%f", p.x * focalLengthX_);
-        xpixel = (int)(p.x * focalLengthX_ / p.z + principalPointX_);
-        ypixel = (int)(p.y * focalLengthY_ / p.z + principalPointY_);
-        ROS_INFO("xpixel: %d ypixel %d", xpixel, ypixel);
-
-        // yInfo() << "xpixel: " << xpixel << "ypixel: " << ypixel;
-        if (xpixel > width_)
-            xpixel = width_;
-        if (ypixel > height_)
-            ypixel = height_;
-        if (xpixel < 0)
-            xpixel = 0;
-        if (ypixel < 0)
-            ypixel = 0;
+        if (!labelImageUpToDate)
+        {
+            buildFrameLabelImage(frame);
+        }
+        labelImagePublisher_.publish(cv_bridge::CvImage(frame.depth->header, sensor_msgs::image_encodings::MONO16, frame.labelImage).toImageMsg());
     }
 
     bool GraspObjects::getSuperquadrics(sharon_msgs::GetSuperquadrics::Request &req, sharon_msgs::GetSuperquadrics::Response &res)
     {
         ROS_INFO("[GraspObjects] GetSuperquadrics().");
-        sharon_msgs::SuperquadricMultiArray superquadrics;
-        geometry_msgs::PoseArray graspingPoses;
-
-        res.superquadrics = superquadricsMsg_;
+        std::shared_ptr<const SceneSnapshot> scene = sceneSnapshot();
+        res.superquadrics = scene->superquadrics;
+        res.scene_version = scene->version;
 
         return true;
     }
@@ -273,264 +543,444 @@ namespace grasp_objects
     bool GraspObjects::getBboxes(sharon_msgs::GetBboxes::Request &req, sharon_msgs::GetBboxes::Response &res)
     {
         ROS_INFO("[GraspObjects] getBboxes().");
-        sharon_msgs::BoundingBoxes boundingBoxes;
-        boundingBoxes.header.stamp = ros::Time::now();
-
-        for (int i = 0; i < superquadricsMsg_.superquadrics.size(); i++)
-        {
-            ROS_INFO("[GraspObjects] SQ: %d", i);
-            sharon_msgs::BoundingBox bbox;
-            createBoundingBox2DFromSuperquadric(superquadricsMsg_.superquadrics[i], bbox);
-            boundingBoxes.bounding_boxes.push_back(bbox);
-        }
-        res.bounding_boxes = boundingBoxes;
+        std::shared_ptr<const SceneSnapshot> scene = sceneSnapshot();
+        res.bounding_boxes = scene->boundingBoxes;
+        res.scene_version = scene->version;
+        return true;
     }
 
     bool GraspObjects::computeGraspPoses(sharon_msgs::ComputeGraspPoses::Request &req, sharon_msgs::ComputeGraspPoses::Response &res)
     {
         ROS_INFO("[GraspObjects] computeGraspPoses().");
-        geometry_msgs::PoseArray graspingPoses;
 
-        int idx = -1;
-        ROS_INFO("superquadricObjects_.size(): %d", superquadricObjects_.size());
-        for (int i = 0; i < superquadricObjects_.size(); i++)
+        bool inScene = false;
+        for (const auto &object : sceneSnapshot()->objects)
         {
-            ROS_INFO("superquadricObjects_[%d].label: %d, id: %d", i, superquadricObjects_[i].label, req.id);
-            if (superquadricObjects_[i].label == req.id)
+            if (object.label == req.id)
             {
-                idx = i;
+                inScene = true;
                 break;
             }
         }
-        if (idx == -1)
+        res.success = false;
+        if (!inScene)
         {
-            res.success = false;
+            ROS_WARN("[GraspObjects] Object %d is not in the scene", req.id);
+            return true;
         }
-        else
+
+        std::unique_lock<std::mutex> lock(mtxGraspCache_);
+        if (!waitForGrasps({req.id}, lock))
         {
-            computeGraspingPosesObject(superquadricObjects_[idx].superqs, graspingPoses);
-            res.poses = graspingPoses;
-            res.success = true;
+            ROS_WARN("[GraspObjects] Grasps of object %d are not available", req.id);
+            return true;
         }
+        const CachedGrasps &cached = graspCache_[req.id];
+        res.poses = cached.poses;
+        res.scores = cached.scores;
+        res.success = true;
+        lock.unlock();
 
-        graspPosesPublisher_.publish(graspingPoses);
+        if (graspPosesPublisher_.getNumSubscribers() > 0)
+        {
+            graspPosesPublisher_.publish(res.poses);
+        }
 
         return true;
     }
 
-    void GraspObjects::computeGraspingPosesObject(const std::vector<SuperqModel::Superquadric> &superqs, geometry_msgs::PoseArray &graspingPoses)
+    bool GraspObjects::computeGraspPosesBatch(sharon_msgs::ComputeGraspPosesBatch::Request &req, sharon_msgs::ComputeGraspPosesBatch::Response &res)
     {
+        ROS_INFO("[GraspObjects] computeGraspPosesBatch().");
 
-        graspingPoses.header.frame_id = "base_footprint";
-        graspingPoses.header.stamp = ros::Time::now();
+        std::vector<int> ids;
+        for (const auto &object : sceneSnapshot()->objects)
+        {
+            if (req.ids.empty() || std::find(req.ids.begin(), req.ids.end(), object.label) != req.ids.end())
+                ids.push_back(object.label);
+        }
+        // Requested ids that are not in the scene make the call unsuccessful
+        bool allInScene = req.ids.empty() || ids.size() == req.ids.size();
 
-        auto params = superqs[0].getSuperqParams();
+        std::unique_lock<std::mutex> lock(mtxGraspCache_);
+        res.success = waitForGrasps(ids, lock) && allInScene;
+        res.objects.reserve(ids.size());
+        for (int id : ids)
+        {
+            auto it = graspCache_.find(id);
+            if (it == graspCache_.end())
+                continue;
+            sharon_msgs::ObjectGraspPoses object;
+            object.id = id;
+            object.poses = it->second.poses;
+            object.scores = it->second.scores;
+            res.objects.push_back(std::move(object));
+        }
+        ROS_INFO("[GraspObjects] Grasps of %d objects returned", (int)res.objects.size());
 
-        Eigen::AngleAxisf rollAngle(params[8], Eigen::Vector3f::UnitZ());
-        Eigen::AngleAxisf yawAngle(params[9], Eigen::Vector3f::UnitY());
-        Eigen::AngleAxisf pitchAngle(params[10], Eigen::Vector3f::UnitZ());
+        return true;
+    }
 
-        Eigen::Quaternionf q = rollAngle * yawAngle * pitchAngle;
+    bool GraspObjects::waitForGrasps(const std::vector<int> &ids, std::unique_lock<std::mutex> &lock)
+    {
+        // The grasps are usually ready, wait only while the thread is still working on this scene
+        auto cached = [this, &ids]
+        {
+            for (int id : ids)
+                if (graspCache_.count(id) == 0)
+                    return false;
+            return true;
+        };
+        cvGraspCache_.wait_for(lock, std::chrono::duration<double>(graspCacheTimeout_), [this, &cached]
+                               { return cached() || (!graspScenePending_ && !graspCacheBusy_); });
+        return cached();
+    }
 
-        KDL::Rotation rot_aux = KDL::Rotation::Quaternion(q.x(), q.y(), q.z(), q.w());
-        KDL::Frame frame_object_wrt_world(rot_aux);
-        frame_object_wrt_world.p[0] = params[5];
-        frame_object_wrt_world.p[1] = params[6];
-        frame_object_wrt_world.p[2] = params[7];
+    std::shared_ptr<const SceneSnapshot> GraspObjects::sceneSnapshot() const
+    {
+        return std::atomic_load(&scene_);
+    }
 
-        KDL::Frame frame_grasping_wrt_world;
-        std::cout << "axes length: " << 2 * params[0] << " " << 2 * params[1] << ": " << 2 * params[2] << std::endl;
+    void GraspObjects::publishSceneSnapshot(const std::shared_ptr<SceneSnapshot> &scene)
+    {
+        // Only the perception thread publishes scenes, readers holding the previous one keep it until they release it
+        scene->version = ++sceneVersion_;
+        std::atomic_store(&scene_, std::shared_ptr<const SceneSnapshot>(scene));
+    }
 
-        float step = 0.025;
-        if (2 * params[2] <= MAX_OBJECT_WIDTH_GRASP)
+    void GraspObjects::scheduleGraspPrecomputation(const SceneSnapshot &scene)
+    {
+        std::vector<std::pair<int, std::vector<Eigen::VectorXd>>> graspScene;
+        graspScene.reserve(scene.objects.size());
+        for (const auto &object : scene.objects)
+        {
+            std::vector<Eigen::VectorXd> params;
+            for (const auto &superq : object.superqs)
+                params.push_back(superq.getSuperqParams());
+            graspScene.emplace_back(object.label, std::move(params));
+        }
         {
-            KDL::Vector zobject;
-            KDL::Vector yobject;
-            KDL::Vector xobject;
-            KDL::Rotation rot;
-            KDL::Frame frameTCP, frame_grasping_wrt_object;
-            std::vector<double> tcpX;
+            std::lock_guard<std::mutex> lock(mtxGraspCache_);
+            pendingGraspScene_ = std::move(graspScene);
+            pendingTablePlane_ = scene.tablePlane;
+            graspScenePending_ = true;
+        }
+        cvGraspCache_.notify_all();
+    }
 
-            for (float yaxes = -1.0; yaxes <= 1.0; yaxes += 2)
+    void GraspObjects::graspPrecomputationThread()
+    {
+        auto neighborsOf = [](const std::vector<std::pair<int, std::vector<Eigen::VectorXd>>> &scene, size_t i)
+        {
+            std::vector<Eigen::VectorXd> neighbors;
+            for (size_t j = 0; j < scene.size(); j++)
             {
-                yobject = KDL::Vector(0, yaxes, 0);
-                for (float x = 0; x <= params[0] / 2.0; x += step)
-                {
-                    float xaxes = 1.0;
-                    zobject = KDL::Vector(xaxes, 0.0, 0.0);
-                    xobject = yobject * zobject;
-                    rot = KDL::Rotation(xobject, yobject, zobject);
-                    frameTCP = KDL::Frame(rot);
-                    frameTCP = KDL::Frame(KDL::Rotation::RotZ(M_PI / 2.0)) * frameTCP;
-                    frameTCP = KDL::Frame(KDL::Rotation::RotX(M_PI / 2.0)) * frameTCP;
-                    frame_grasping_wrt_object = frameTCP;
-                    for (int sign = 1.0; sign >= -1; sign -= 2.0)
-                    {
-                        frame_grasping_wrt_object.p[0] = sign * x;
-                        frame_grasping_wrt_object.p[1] = -yaxes * params[1];
-                        frame_grasping_wrt_object.p[2] = 0;
-                        frame_grasping_wrt_world = frame_object_wrt_world * frame_grasping_wrt_object;
-                        // Check if is trying to grasp from the bottom of the objet
-                        KDL::Vector unitx = frame_grasping_wrt_world.M.UnitX();
-                        KDL::Vector unity = frame_grasping_wrt_world.M.UnitY();
-                        KDL::Vector unitz = frame_grasping_wrt_world.M.UnitZ();
-
-                        KDL::Vector axesz(1, 0, 0);
-                        float angle = atan2((unitz * axesz).Norm(), dot(unitz, axesz));
-                        // printf("angle: %f\n", angle * M_1_PI / 180.0);
-                        if (angle > 20 * M_PI / 180.0)
-                        {
-                            geometry_msgs::Pose pose;
-                            tf::poseKDLToMsg(frame_grasping_wrt_world, pose);
-                            // printf("%f %f %f %f %f %f\n", tcpX[0], tcpX[1], tcpX[2], tcpX[3], tcpX[4], tcpX[5]);
-                            graspingPoses.poses.push_back(pose);
-                        }
-                    }
-                }
+                if (j != i)
+                    neighbors.insert(neighbors.end(), scene[j].second.begin(), scene[j].second.end());
             }
+            return neighbors;
+        };
 
-            float yaxes = 1.0;
-
-            for (float xaxes = -1.0; xaxes <= 1.0; xaxes += 2)
+        while (true)
+        {
+            std::vector<std::pair<int, std::vector<Eigen::VectorXd>>> scene;
+            Eigen::Vector4f tablePlane;
+            std::vector<size_t> changed;
             {
-                xobject = KDL::Vector(xaxes, 0, 0);
-                for (float y = 0; y <= params[1] / 2.0; y += step)
-                // for (float y = -params[1] / 2.0; y <= params[1] / 2.0; y += step)
+                std::unique_lock<std::mutex> lock(mtxGraspCache_);
+                cvGraspCache_.wait(lock, [this]
+                                   { return stopGraspThread_ || graspScenePending_; });
+                if (stopGraspThread_)
+                    return;
+                scene = std::move(pendingGraspScene_);
+                tablePlane = pendingTablePlane_;
+                graspScenePending_ = false;
+
+                // Objects that left the scene lose their grasps. Objects whose superquadrics, neighbors or table moved lose them too,
+                // their previous grasps may collide or miss the new geometry, and ComputeGraspPoses waits for the recomputed ones
+                std::unordered_map<int, CachedGrasps> kept;
+                for (size_t i = 0; i < scene.size(); i++)
                 {
-                    zobject = KDL::Vector(0, yaxes, 0.0);
-                    yobject = zobject * xobject;
-                    rot = KDL::Rotation(xobject, yobject, zobject);
-                    frameTCP = KDL::Frame(rot);
-                    frameTCP = KDL::Frame(KDL::Rotation::RotX(-M_PI / 2.0)) * frameTCP;
-
-                    for (int sign = 1; sign >= -1; sign -= 2)
+                    auto it = graspCache_.find(scene[i].first);
+                    if (it == graspCache_.end())
                     {
-                        frame_grasping_wrt_object = frameTCP;
-                        frame_grasping_wrt_object.p[0] = -xaxes * params[0];
-                        frame_grasping_wrt_object.p[1] = sign * y;
-                        frame_grasping_wrt_object.p[2] = 0;
-                        frame_grasping_wrt_world = frame_object_wrt_world * frame_grasping_wrt_object;
-                        // Check if is trying to grasp from the bottom of the objet
-                        KDL::Vector unitx = frame_grasping_wrt_world.M.UnitX();
-                        KDL::Vector unity = frame_grasping_wrt_world.M.UnitY();
-                        KDL::Vector unitz = frame_grasping_wrt_world.M.UnitZ();
-
-                        KDL::Vector axesz(1, 0, 0);
-                        float angle = atan2((unitz * axesz).Norm(), dot(unitz, axesz));
-                        // printf("angle: %f\n", angle * 180.0 / M_PI);
-                        if (angle > 20 * M_PI / 180.0)
-                        {
-                            geometry_msgs::Pose pose;
-                            tf::poseKDLToMsg(frame_grasping_wrt_world, pose);
-                            // printf("%f %f %f %f %f %f\n", tcpX[0], tcpX[1], tcpX[2], tcpX[3], tcpX[4], tcpX[5]);
-                            graspingPoses.poses.push_back(pose);
-                        }
+                        changed.push_back(i);
+                        continue;
                     }
+                    if (!similarSuperquadrics(it->second.superqs, scene[i].second, graspCacheTolerances_) ||
+                        !similarSuperquadrics(it->second.neighbors, neighborsOf(scene, i), graspCacheTolerances_) ||
+                        !similarPlane(it->second.tablePlane, tablePlane, graspCacheTolerances_))
+                    {
+                        changed.push_back(i);
+                        continue;
+                    }
+                    kept[scene[i].first] = std::move(it->second);
                 }
+                graspCache_ = std::move(kept);
+                graspCacheBusy_ = !changed.empty();
+            }
+            if (changed.empty())
+            {
+                cvGraspCache_.notify_all();
+                continue;
             }
+
+            // Objects are independent, each one is generated and ranked on its own task
+            updateShoulderPosition();
+            std::vector<std::future<void>> tasks;
+            tasks.reserve(changed.size());
+            for (size_t i : changed)
+            {
+                tasks.push_back(std::async(std::launch::async, [this, &scene, &tablePlane, &neighborsOf, i]
+                                           {
+                                               CachedGrasps grasps;
+                                               grasps.neighbors = neighborsOf(scene, i);
+                                               grasps.tablePlane = tablePlane;
+                                               computeGraspingPosesObject(scene[i].second, grasps.neighbors, tablePlane, grasps.poses, grasps.scores);
+                                               grasps.superqs = scene[i].second;
+                                               {
+                                                   std::lock_guard<std::mutex> lock(mtxGraspCache_);
+                                                   graspCache_[scene[i].first] = std::move(grasps);
+                                               }
+                                               cvGraspCache_.notify_all();
+                                           }));
+            }
+            for (auto &task : tasks)
+                task.get();
+            {
+                std::lock_guard<std::mutex> lock(mtxGraspCache_);
+                graspCacheBusy_ = false;
+            }
+            cvGraspCache_.notify_all();
         }
+    }
+
+    void GraspObjects::computeGraspingPosesObject(const std::vector<Eigen::VectorXd> &superqs, const std::vector<Eigen::VectorXd> &neighbors,
+                                                  const Eigen::Vector4f &tablePlane, geometry_msgs::PoseArray &graspingPoses, std::vector<float> &scores)
+    {
+
+        graspingPoses.header.frame_id = "base_footprint";
+        graspingPoses.header.stamp = ros::Time::now();
+
+        if (superqs.empty())
+            return;
+
+        GraspCandidates candidates;
+        graspGenerator_.generate(superqs[0], candidates);
+        int generated = candidates.size();
 
-        if (2 * params[1] <= MAX_OBJECT_WIDTH_GRASP)
+        // Candidates blocked by the neighbors or the table never reach the ranking nor the IK
+        std::vector<int> free;
+        gripperFilter_.filter(candidates, neighbors, tablePlane, free);
+        candidates.select(free);
+
+        // Center of mass of the object as the volume weighted mean of its superquadric centers
+        Eigen::Vector3f centerOfMass = Eigen::Vector3f::Zero();
+        float totalVolume = 0;
+        for (const Eigen::VectorXd &params : superqs)
         {
-            KDL::Vector zobject;
-            KDL::Vector yobject;
-            KDL::Vector xobject;
-            KDL::Rotation rot;
-            KDL::Frame frameTCP, frame_grasping_wrt_object;
-            std::vector<double> tcpX;
+            float volume = params[0] * params[1] * params[2];
+            centerOfMass += volume * Eigen::Vector3f(params[5], params[6], params[7]);
+            totalVolume += volume;
+        }
+        centerOfMass /= std::max(totalVolume, 1e-9f);
 
-            for (float yaxes = -1.0; yaxes <= 1.0; yaxes += 2)
+        std::vector<int> order;
+        graspScorer_.rank(candidates, centerOfMass, neighbors, order, scores);
+        GraspCandidateGenerator::toPoseArray(candidates, order, graspingPoses);
+        ROS_INFO("[GraspObjects] %d grasp candidates, %d collision free, %d after pruning duplicates, best score %f", generated, candidates.size(),
+                 (int)order.size(), scores.empty() ? 0.0f : scores[0]);
+    }
+
+    void GraspObjects::loadGripperCollisionParams()
+    {
+        float tableMargin = 0.01;
+        int pointsPerEdge = 3;
+        ros::param::get("grasp_objects/gripper_collision/table_margin", tableMargin);
+        ros::param::get("grasp_objects/gripper_collision/points_per_edge", pointsPerEdge);
+        gripperFilter_.setTableMargin(tableMargin);
+        gripperFilter_.setPointsPerEdge(pointsPerEdge);
+
+        XmlRpc::XmlRpcValue boxes;
+        if (!ros::param::get("grasp_objects/gripper_collision/boxes", boxes) || boxes.getType() != XmlRpc::XmlRpcValue::TypeArray)
+        {
+            ROS_INFO("[GraspObjects] Default gripper collision boxes.");
+            return;
+        }
+        std::vector<GripperBox> gripperBoxes;
+        for (int i = 0; i < boxes.size(); i++)
+        {
+            GripperBox box;
+            for (int j = 0; j < 3; j++)
             {
-                yobject = KDL::Vector(0, yaxes, 0);
-                for (float x = 0; x <= params[0] / 2.0; x += step)
-                {
-                    float xaxes = -1.0;
-                    zobject = KDL::Vector(0.0, 0.0, xaxes);
-                    xobject = yobject * zobject;
-                    rot = KDL::Rotation(xobject, yobject, zobject);
-                    frameTCP = KDL::Frame(rot);
-                    frameTCP = KDL::Frame(KDL::Rotation::RotZ(M_PI / 2.0)) * frameTCP;
-                    frameTCP = KDL::Frame(KDL::Rotation::RotX(M_PI / 2.0)) * frameTCP;
-                    frame_grasping_wrt_object = frameTCP;
-                    for (int sign = 1.0; sign >= -1; sign -= 2.0)
-                    {
-                        frame_grasping_wrt_object.p[0] = sign * x;
-                        frame_grasping_wrt_object.p[1] = 0;
-                        frame_grasping_wrt_object.p[2] = yaxes * params[2];
-                        frame_grasping_wrt_world = frame_object_wrt_world * frame_grasping_wrt_object;
-                        // Check if is trying to grasp from the bottom of the objet
-                        KDL::Vector unitx = frame_grasping_wrt_world.M.UnitX();
-                        KDL::Vector unity = frame_grasping_wrt_world.M.UnitY();
-                        KDL::Vector unitz = frame_grasping_wrt_world.M.UnitZ();
-
-                        KDL::Vector axesz(1, 0, 0);
-                        float angle = atan2((unitz * axesz).Norm(), dot(unitz, axesz));
-                        // printf("angle: %f\n", angle * M_1_PI / 180.0);
-                        if (angle > 20 * M_PI / 180.0)
-                        {
-                            geometry_msgs::Pose pose;
-                            tf::poseKDLToMsg(frame_grasping_wrt_world, pose);
-                            // printf("%f %f %f %f %f %f\n", tcpX[0], tcpX[1], tcpX[2], tcpX[3], tcpX[4], tcpX[5]);
-                            graspingPoses.poses.push_back(pose);
-                        }
-                    }
-                }
+                box.center[j] = static_cast<double>(boxes[i]["center"][j]);
+                box.halfExtents[j] = static_cast<double>(boxes[i]["half_extents"][j]);
             }
+            gripperBoxes.push_back(box);
+        }
+        gripperFilter_.setBoxes(gripperBoxes);
+        ROS_INFO("[GraspObjects] %d gripper collision boxes loaded.", (int)gripperBoxes.size());
+    }
 
-            float yaxes = 1.0;
+    void GraspObjects::loadGraspScoringParams()
+    {
+        GraspScoringParams params;
+        ros::param::get("grasp_objects/grasp_scoring/shoulder_frame", shoulderFrame_);
+        ros::param::get("grasp_objects/grasp_scoring/approach_weight", params.approachWeight);
+        ros::param::get("grasp_objects/grasp_scoring/reach_weight", params.reachWeight);
+        ros::param::get("grasp_objects/grasp_scoring/clearance_weight", params.clearanceWeight);
+        ros::param::get("grasp_objects/grasp_scoring/center_of_mass_weight", params.centerOfMassWeight);
+        ros::param::get("grasp_objects/grasp_scoring/preferred_reach", params.preferredReach);
+        ros::param::get("grasp_objects/grasp_scoring/reach_tolerance", params.reachTolerance);
+        ros::param::get("grasp_objects/grasp_scoring/clearance_saturation", params.clearanceSaturation);
+        ros::param::get("grasp_objects/grasp_scoring/gripper_length", params.gripperLength);
+        ros::param::get("grasp_objects/grasp_scoring/center_of_mass_tolerance", params.centerOfMassTolerance);
+        ros::param::get("grasp_objects/grasp_scoring/duplicate_distance", params.duplicateDistance);
+        ros::param::get("grasp_objects/grasp_scoring/duplicate_angle", params.duplicateAngle);
+        graspScorer_.setParams(params);
+
+        std::vector<double> shoulder;
+        if (ros::param::get("grasp_objects/grasp_scoring/shoulder_position", shoulder) && shoulder.size() == 3)
+        {
+            graspScorer_.setShoulderPosition(Eigen::Vector3f(shoulder[0], shoulder[1], shoulder[2]));
+        }
+        ROS_INFO("[GraspObjects] grasp_objects/grasp_scoring/shoulder_frame set to %s", shoulderFrame_.c_str());
+    }
 
-            for (float xaxes = -1.0; xaxes <= 1.0; xaxes += 2)
-            {
-                xobject = KDL::Vector(xaxes, 0, 0);
-                for (float y = 0; y <= params[1] / 2.0; y += step)
-                // for (float y = -params[1] / 2.0; y <= params[1] / 2.0; y += step)
-                {
-                    zobject = KDL::Vector(0, yaxes, 0.0);
-                    yobject = zobject * xobject;
-                    rot = KDL::Rotation(xobject, yobject, zobject);
-                    frameTCP = KDL::Frame(rot);
-                    frameTCP = KDL::Frame(KDL::Rotation::RotX(-M_PI / 2.0)) * frameTCP;
+    void GraspObjects::loadSceneStabilityParams()
+    {
+        SceneStabilityParams params;
+        ros::param::get("grasp_objects/scene_stability/frames", params.frames);
+        ros::param::get("grasp_objects/scene_stability/max_centroid_drift", params.maxCentroidDrift);
+        ros::param::get("grasp_objects/scene_stability/max_axis_delta", params.maxAxisDelta);
+        ros::param::get("grasp_objects/scene_stability/max_exponent_delta", params.maxExponentDelta);
+        stabilityDetector_.setParams(params);
+        ROS_INFO("[GraspObjects] grasp_objects/scene_stability/frames set to %d", params.frames);
+    }
 
-                    for (int sign = 1; sign >= -1; sign -= 2)
-                    {
-                        frame_grasping_wrt_object = frameTCP;
-                        frame_grasping_wrt_object.p[0] = -xaxes * params[0];
-                        frame_grasping_wrt_object.p[1] = sign * y;
-                        frame_grasping_wrt_object.p[2] = 0;
-                        frame_grasping_wrt_world = frame_object_wrt_world * frame_grasping_wrt_object;
-                        // Check if is trying to grasp from the bottom of the objet
-                        KDL::Vector unitx = frame_grasping_wrt_world.M.UnitX();
-                        KDL::Vector unity = frame_grasping_wrt_world.M.UnitY();
-                        KDL::Vector unitz = frame_grasping_wrt_world.M.UnitZ();
-
-                        KDL::Vector axesz(1, 0, 0);
-                        float angle = atan2((unitz * axesz).Norm(), dot(unitz, axesz));
-                        printf("angle: %f\n", angle * 180.0 / M_PI);
-                        if (angle > 20 * M_PI / 180.0)
-                        {
-
-                            geometry_msgs::Pose pose;
-                            tf::poseKDLToMsg(frame_grasping_wrt_world, pose);
-                            // printf("%f %f %f %f %f %f\n", tcpX[0], tcpX[1], tcpX[2], tcpX[3], tcpX[4], tcpX[5]);
-                            graspingPoses.poses.push_back(pose);
-                        }
-                    }
-                }
-            }
+    void GraspObjects::updateShoulderPosition()
+    {
+        // The torso lift moves the shoulder, the configured position is kept if tf does not know the frame
+        try
+        {
+            tf::StampedTransform transformShoulderWrtBase;
+            listener_.lookupTransform("/base_footprint", shoulderFrame_, ros::Time(0), transformShoulderWrtBase);
+            const tf::Vector3 &origin = transformShoulderWrtBase.getOrigin();
+            graspScorer_.setShoulderPosition(Eigen::Vector3f(origin.x(), origin.y(), origin.z()));
+        }
+        catch (const tf::TransformException &ex)
+        {
+            ROS_WARN("[GraspObjects] %s", ex.what());
         }
     }
 
     bool GraspObjects::activateSuperquadricsComputation(sharon_msgs::ActivateSupercuadricsComputation::Request &req, sharon_msgs::ActivateSupercuadricsComputation::Response &res)
     {
-
-        mtxActivate_.lock();
-        activate_ = req.activate;
-        ROS_INFO("[GraspObjects] Activate superquadrics Computation: %d", activate_);
+        setActivation(req.activate);
         res.success = true;
-        mtxActivate_.unlock();
         return true;
     }
 
+    bool GraspObjects::setActivation(bool activate)
+    {
+        bool previous = activate_.exchange(activate);
+        if (activate && !previous)
+            resetStability_ = true;
+        // Shutting the subscriber down waits for a depth callback in flight, which may wait on the pipeline,
+        // so the subscription is changed on the perception thread between two callbacks instead of here
+        if (activate != previous)
+            perceptionQueue_.addCallback(boost::make_shared<FunctionCallback>(boost::bind(&GraspObjects::updateDepthSubscription, this)));
+        ROS_INFO("[GraspObjects] Activate superquadrics Computation: %d", activate);
+        return previous;
+    }
+
+    void GraspObjects::updateDepthSubscription()
+    {
+        // Only the perception thread runs this, activate_ may have changed again since it was queued
+        if (activate_ && !depthSubscribed_)
+        {
+            // The camera model is loaded once in init(), so the first image received can be processed right away
+            compressedDepthImageSubscriber_ = perceptionIt_->subscribe(compressedDepthImageTopicName_, 10, &GraspObjects::compressedDepthImageCallback, this,
+                                                                       image_transport::TransportHints("raw"));
+            depthSubscribed_ = true;
+        }
+        else if (!activate_ && depthSubscribed_)
+        {
+            // No images are received nor deserialized while idle, frames already in the pipeline are still published
+            compressedDepthImageSubscriber_.shutdown();
+            depthSubscribed_ = false;
+        }
+    }
+
+    void GraspObjects::computeScene(const sharon_msgs::ComputeSceneGoalConstPtr &goal)
+    {
+        int frames = std::max(goal->frames, 1);
+        ROS_INFO("[GraspObjects] computeScene() of %d frames.", frames);
+        std::unique_lock<std::mutex> lock(mtxComputeScene_);
+        // Frames already in the pipeline were taken before the goal, only the next ones count
+        sceneGoalFirstFrame_ = frameSequence_;
+        sceneGoalScenes_ = 0;
+        sceneGoalStable_ = false;
+        sceneGoalConfidence_ = 0;
+        sceneGoalActive_ = true;
+        lock.unlock();
+        bool wasActive = setActivation(true);
+
+        ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(goal->timeout);
+        lock.lock();
+        while (sceneGoalScenes_ < frames && !(goal->until_stable && sceneGoalStable_) && !stopComputeScene_ && ros::ok() &&
+               !computeSceneServer_->isPreemptRequested() && (goal->timeout <= 0 || ros::WallTime::now() < deadline))
+        {
+            cvComputeScene_.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        bool done = goal->until_stable ? sceneGoalStable_ : sceneGoalScenes_ >= frames;
+        bool stable = sceneGoalStable_;
+        float confidence = sceneGoalConfidence_;
+        int scenes = sceneGoalScenes_;
+        sceneGoalActive_ = false;
+        lock.unlock();
+        // Computation started through the service goes on after the goal
+        if (!wasActive)
+            setActivation(false);
+
+        std::shared_ptr<const SceneSnapshot> scene = sceneSnapshot();
+        sharon_msgs::ComputeSceneResult result;
+        result.success = done;
+        result.stable = stable;
+        result.confidence = confidence;
+        result.superquadrics = scene->superquadrics;
+        result.bounding_boxes = scene->boundingBoxes;
+        for (const auto &object : scene->objects)
+            result.ids.push_back(object.label);
+        result.scene_version = scene->version;
+        result.frames = scenes;
+        ROS_INFO("[GraspObjects] Scene %lu with %d objects after %d of %d frames, stable: %d", (unsigned long)scene->version, (int)result.ids.size(),
+                 std::min(scenes, frames), frames, stable);
+        if (done)
+            computeSceneServer_->setSucceeded(result);
+        else if (computeSceneServer_->isPreemptRequested())
+            computeSceneServer_->setPreempted(result);
+        else
+            computeSceneServer_->setAborted(result);
+    }
+
+    void GraspObjects::reportStage(const std::string &stage, const PerceptionFrame &frame)
+    {
+        std::lock_guard<std::mutex> lock(mtxComputeScene_);
+        if (!sceneGoalActive_ || frame.sequence < sceneGoalFirstFrame_)
+            return;
+        sharon_msgs::ComputeSceneFeedback feedback;
+        feedback.frame = frame.sequence - sceneGoalFirstFrame_;
+        feedback.stage = stage;
+        computeSceneServer_->publishFeedback(feedback);
+        // The scene of the frame is published once the last stage is done
+        if (stage == "publish")
+        {
+            sceneGoalScenes_++;
+            cvComputeScene_.notify_all();
+        }
+    }
+
     void GraspObjects::supervoxelOversegmentation(const pcl::PointCloud<pcl::PointXYZ>::Ptr &inputPointCloud, pcl::PointCloud<pcl::PointXYZL>::Ptr &lccp_labeled_cloud)
     {
 
@@ -627,9 +1077,9 @@ namespace grasp_objects
         // PCL_INFO ("relabel\n");
     }
 
-    void GraspObjects::updateDetectedObjectsPointCloud(const pcl::PointCloud<pcl::PointXYZL>::Ptr &lccp_labeled_cloud)
+    void GraspObjects::updateDetectedObjectsPointCloud(const pcl::PointCloud<pcl::PointXYZL>::Ptr &lccp_labeled_cloud, std::vector<Object> &detectedObjects)
     {
-        detectedObjects_.clear();
+        detectedObjects.clear();
         for (int i = 0; i < lccp_labeled_cloud->points.size(); ++i)
         {
 
@@ -639,9 +1089,9 @@ namespace grasp_objects
 
                 // in this way we enlarges the vector everytime we encounter a greater label. So we don't need to pass all
                 //  labeeld point cloud to see what is the greater label, and then to resize the vector.
-                if (idx >= detectedObjects_.size()) // keep in mind that there is also the label 0!
+                if (idx >= detectedObjects.size()) // keep in mind that there is also the label 0!
                 {
-                    detectedObjects_.resize(idx + 1);
+                    detectedObjects.resize(idx + 1);
                 }
                 // if (detected_objects[idx].object_cloud.empty())
                 // {
@@ -657,241 +1107,447 @@ namespace grasp_objects
                 tmp_point_rgb.g = rand() % 256;
                 tmp_point_rgb.b = rand() % 256;
 
-                detectedObjects_[idx].object_cloud.points.push_back(tmp_point_rgb);
-                detectedObjects_[idx].label = (int)idx;
+                detectedObjects[idx].object_cloud.points.push_back(tmp_point_rgb);
+                detectedObjects[idx].label = (int)idx;
             }
         }
 
         // remove segments with too few points
         // it will removes te ones with few points or the ones with no points (these are created because of the labels of lccp)
-        int size = detectedObjects_.size();
-        ROS_INFO("[GraspObjects] size: %d", detectedObjects_.size());
+        int size = detectedObjects.size();
+        ROS_INFO("[GraspObjects] size: %d", detectedObjects.size());
 
         int i = 0;
         while (i < size)
         {
-            if (detectedObjects_[i].object_cloud.size() < this->th_points_)
+            if (detectedObjects[i].object_cloud.size() < this->th_points_)
             {
-                detectedObjects_.erase(detectedObjects_.begin() + i);
-                size = detectedObjects_.size();
+                detectedObjects.erase(detectedObjects.begin() + i);
+                size = detectedObjects.size();
             }
             else
             {
-                detectedObjects_[i].object_cloud.width = detectedObjects_[i].object_cloud.size();
-                detectedObjects_[i].object_cloud.height = 1;
+                detectedObjects[i].object_cloud.width = detectedObjects[i].object_cloud.size();
+                detectedObjects[i].object_cloud.height = 1;
                 i++;
             }
         }
-        ROS_INFO("[GraspObjects] size: %d", detectedObjects_.size());
+        ROS_INFO("[GraspObjects] size: %d", detectedObjects.size());
     }
 
     void GraspObjects::compressedDepthImageCallback(const sensor_msgs::ImageConstPtr &depth_msg)
     {
         // ROS_INFO("[GraspObjects] Receiving the compressed depth image");
-        bool activate;
-        mtxActivate_.lock();
-        activate = activate_;
-        mtxActivate_.unlock();
-        if (activate)
-        {
-            sensor_msgs::PointCloud2 pcOut;
-
-            sensor_msgs::PointCloud2::Ptr cloud_msg(new sensor_msgs::PointCloud2);
-            cloud_msg->header = depth_msg->header;
-            cloud_msg->height = depth_msg->height;
-            cloud_msg->width = depth_msg->width;
-            cloud_msg->is_dense = false;
-            cloud_msg->is_bigendian = false;
-
-            sensor_msgs::PointCloud2Modifier pcd_modifier(*cloud_msg);
-            pcd_modifier.setPointCloud2FieldsByString(1, "xyz");
-
-            depth_image_proc::convert<float>(depth_msg, cloud_msg, model_); // TYPE TYPE_32FC1
-
-            pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_without_table(new pcl::PointCloud<pcl::PointXYZ>);
-
-            listener_.lookupTransform("/base_footprint", "/xtion_depth_optical_frame", ros::Time(0), transformCameraWrtBase_);
-
-            pcl_ros::transformPointCloud(std::string("/base_footprint"), transformCameraWrtBase_, *cloud_msg, pcOut);
-
-            pcl::PCLPointCloud2 *cloudFiltered = new pcl::PCLPointCloud2;
-            pcl::PCLPointCloud2ConstPtr cloudFilteredPtr(cloudFiltered);
-            // Convert to PCL data type
-            pcl_conversions::toPCL(pcOut, *cloudFiltered);
-
-            // Perform the actual filtering
-            pcl::VoxelGrid<pcl::PCLPointCloud2> sor;
-            sor.setInputCloud(cloudFilteredPtr);
-            sor.setLeafSize(0.005f, 0.005f, 0.005f);
-            sor.filter(*cloudFiltered);
-
-            // Create the filtering object
-            pcl::PassThrough<pcl::PCLPointCloud2> pass;
-            pass.setInputCloud(cloudFilteredPtr);
-            pass.setFilterFieldName("x");
-            pass.setFilterLimits(0.5, 1.5);
-            // pass.setFilterLimitsNegative (true);
-            pass.filter(*cloudFiltered);
-
-            // Create the filtering object
-            pcl::PassThrough<pcl::PCLPointCloud2> passZ;
-            passZ.setInputCloud(cloudFilteredPtr);
-            passZ.setFilterFieldName("z");
-            passZ.setFilterLimits(0.5, 1.5);
-            // pass.setFilterLimitsNegative (true);
-            passZ.filter(*cloudFiltered);
-
-            pcl::fromPCLPointCloud2(*cloudFiltered, *cloud_without_table);
-
-            // Coefficients and inliners objects for tge ransac plannar model
-            pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients());
-            pcl::PointIndices::Ptr inliers(new pcl::PointIndices());
-            // Create the segmentation object
-            pcl::SACSegmentation<pcl::PointXYZ> seg;
-            // Optional
-            seg.setOptimizeCoefficients(true);
-            // Mandatory
-            seg.setModelType(pcl::SACMODEL_PARALLEL_PLANE);
-            seg.setMethodType(pcl::SAC_RANSAC);
-            seg.setMaxIterations(2000);
-            seg.setDistanceThreshold(distanceThresholdPlaneSegmentation_);
-            seg.setAxis(Eigen::Vector3f::UnitX());
-            seg.setEpsAngle(epsAnglePlaneSegmentation_);
-
-            seg.setInputCloud(cloud_without_table);
-            seg.segment(*inliers, *coefficients);
-            // Create the filtering object
-            pcl::ExtractIndices<pcl::PointXYZ> extract;
-
-            extract.setInputCloud(cloud_without_table);
-            extract.setIndices(inliers);
-            extract.setNegative(true); // Extract the inliers
-            extract.filter(*cloud_without_table);
-
-            pcl::PointCloud<pcl::PointXYZL>::Ptr lccp_labeled_cloud;
-            supervoxelOversegmentation(cloud_without_table, lccp_labeled_cloud);
-
-            // Convert to ROS data type
-            pcl::toPCLPointCloud2(*lccp_labeled_cloud, *cloudFiltered);
-            pcl_conversions::moveFromPCL(*cloudFiltered, pcOut);
-            pcOut.header.frame_id = "/base_footprint";
-            outPointCloudPublisher_.publish(pcOut);
-
-            pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloudSuperquadric(new pcl::PointCloud<pcl::PointXYZRGBA>);
-            superquadricObjects_.clear();
-            if (lccp_labeled_cloud->points.size() != 0)
+        // An image may still be queued when the subscriber is shut down
+        if (activate_)
+        {
+            // Ingest runs here, the frame waits on this thread while the filtering stage is still busy with the previous one
+            std::unique_ptr<PerceptionFrame> frame(new PerceptionFrame);
+            frame->depth = depth_msg;
+            frame->sequence = frameSequence_++;
+            pipeline_.process(std::move(frame));
+        }
+    }
+
+    bool GraspObjects::ingestFrame(PerceptionFrame &frame)
+    {
+        const sensor_msgs::ImageConstPtr &depth_msg = frame.depth;
+        sensor_msgs::PointCloud2::Ptr cloud_msg(new sensor_msgs::PointCloud2);
+        cloud_msg->header = depth_msg->header;
+        cloud_msg->height = depth_msg->height;
+        cloud_msg->width = depth_msg->width;
+        cloud_msg->is_dense = false;
+        cloud_msg->is_bigendian = false;
+
+        sensor_msgs::PointCloud2Modifier pcd_modifier(*cloud_msg);
+        pcd_modifier.setPointCloud2FieldsByString(1, "xyz");
+
+        depth_image_proc::convert<float>(depth_msg, cloud_msg, model_); // TYPE TYPE_32FC1
+
+        tf::StampedTransform transformCameraWrtBase;
+        try
+        {
+            listener_.lookupTransform("/base_footprint", "/xtion_depth_optical_frame", ros::Time(0), transformCameraWrtBase);
+        }
+        catch (const tf::TransformException &ex)
+        {
+            ROS_WARN("[GraspObjects] %s", ex.what());
+            return false;
+        }
+        Eigen::Matrix4f baseFromCamera;
+        pcl_ros::transformAsMatrix(transformCameraWrtBase, baseFromCamera);
+        frame.cameraFromBase = baseFromCamera.inverse();
+
+        pcl_ros::transformPointCloud(std::string("/base_footprint"), transformCameraWrtBase, *cloud_msg, frame.cloud);
+        return true;
+    }
+
+    bool GraspObjects::filterFrame(PerceptionFrame &frame)
+    {
+        pcl::PCLPointCloud2 *cloudFiltered = new pcl::PCLPointCloud2;
+        pcl::PCLPointCloud2ConstPtr cloudFilteredPtr(cloudFiltered);
+        // Convert to PCL data type
+        pcl_conversions::toPCL(frame.cloud, *cloudFiltered);
+
+        // Perform the actual filtering
+        pcl::VoxelGrid<pcl::PCLPointCloud2> sor;
+        sor.setInputCloud(cloudFilteredPtr);
+        sor.setLeafSize(0.005f, 0.005f, 0.005f);
+        sor.filter(*cloudFiltered);
+
+        // Create the filtering object
+        pcl::PassThrough<pcl::PCLPointCloud2> pass;
+        pass.setInputCloud(cloudFilteredPtr);
+        pass.setFilterFieldName("x");
+        pass.setFilterLimits(0.5, 1.5);
+        // pass.setFilterLimitsNegative (true);
+        pass.filter(*cloudFiltered);
+
+        // Create the filtering object
+        pcl::PassThrough<pcl::PCLPointCloud2> passZ;
+        passZ.setInputCloud(cloudFilteredPtr);
+        passZ.setFilterFieldName("z");
+        passZ.setFilterLimits(0.5, 1.5);
+        // pass.setFilterLimitsNegative (true);
+        passZ.filter(*cloudFiltered);
+
+        pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_without_table(new pcl::PointCloud<pcl::PointXYZ>);
+        pcl::fromPCLPointCloud2(*cloudFiltered, *cloud_without_table);
+        // The base frame cloud is not needed by the later stages
+        frame.cloud = sensor_msgs::PointCloud2();
+
+        // Coefficients and inliners objects for tge ransac plannar model
+        pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients());
+        pcl::PointIndices::Ptr inliers(new pcl::PointIndices());
+        // Create the segmentation object
+        pcl::SACSegmentation<pcl::PointXYZ> seg;
+        // Optional
+        seg.setOptimizeCoefficients(true);
+        // Mandatory
+        seg.setModelType(pcl::SACMODEL_PARALLEL_PLANE);
+        seg.setMethodType(pcl::SAC_RANSAC);
+        seg.setMaxIterations(2000);
+        seg.setDistanceThreshold(distanceThresholdPlaneSegmentation_);
+        seg.setAxis(Eigen::Vector3f::UnitX());
+        seg.setEpsAngle(epsAnglePlaneSegmentation_);
+
+        seg.setInputCloud(cloud_without_table);
+        seg.segment(*inliers, *coefficients);
+
+        // The table plane gives the height the objects stand on
+        frame.tablePlane = tablePlane(*coefficients);
+        // Create the filtering object
+        pcl::ExtractIndices<pcl::PointXYZ> extract;
+
+        extract.setInputCloud(cloud_without_table);
+        extract.setIndices(inliers);
+        extract.setNegative(true); // Extract the inliers
+        extract.filter(*cloud_without_table);
+        frame.cloudWithoutTable = cloud_without_table;
+        return true;
+    }
+
+    bool GraspObjects::segmentFrame(PerceptionFrame &frame)
+    {
+        supervoxelOversegmentation(frame.cloudWithoutTable, frame.labeledCloud);
+        frame.cloudWithoutTable.reset();
+
+        if (segmentationOutput_ != "label_image" && debugPublisher_.wants("/transformed_cloud"))
+        {
+            debugPublisher_.publishCloud<pcl::PointXYZL>("/transformed_cloud", frame.labeledCloud, "/base_footprint");
+        }
+
+        // The scene is built in a private buffer and published at the end, so the services never see a half built one
+        frame.scene = std::make_shared<SceneSnapshot>();
+        frame.scene->superquadrics.header.stamp = ros::Time::now();
+        frame.scene->superquadrics.header.frame_id = "base_footprint";
+        frame.scene->boundingBoxes.header = frame.depth->header;
+        frame.scene->tablePlane = frame.tablePlane;
+        if (frame.labeledCloud->points.size() != 0)
+        {
+            updateDetectedObjectsPointCloud(frame.labeledCloud, frame.objects);
+
+            // Boxes from the segmentation are available before any superquadric is fitted
+            bool bboxesFromLabels = bboxSource_ == "label_image";
+            if (bboxesFromLabels)
             {
+                computeBoundingBoxesFromLabels(frame, frame.scene->boundingBoxes);
+                boundingBoxesPublisher_.publish(frame.scene->boundingBoxes);
+            }
+            if (segmentationOutput_ != "cloud" && labelImagePublisher_.getNumSubscribers() > 0)
+            {
+                publishLabelImage(frame, bboxesFromLabels);
+            }
+        }
+        return true;
+    }
 
-                sharon_msgs::SuperquadricMultiArray aux;
-                superquadricsMsg_ = aux;
-                superquadricsMsg_.header.stamp = ros::Time::now();
-                updateDetectedObjectsPointCloud(lccp_labeled_cloud);
+    bool GraspObjects::fitFrame(PerceptionFrame &frame)
+    {
+        SceneSnapshot &scene = *frame.scene;
+        bool publishSuperqsCloud = debugPublisher_.wants("/grasp_objects/superquadrics_cloud");
+        bool publishAddedPoints = debugPublisher_.wants("/added_points");
+        pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloudSuperquadric(new pcl::PointCloud<pcl::PointXYZRGBA>);
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr allPoints(new pcl::PointCloud<pcl::PointXYZRGB>);
+        for (Object &object : frame.objects)
+        {
 
-                std::vector<std::vector<double>> graspingPoses;
-                pcl::PointCloud<pcl::PointXYZRGB>::Ptr allPoints;
+            Eigen::Vector4f centroid;
+            pcl::compute3DCentroid(object.object_cloud, centroid);
+            float tableHeight = tableHeightAt(frame.tablePlane, centroid[0], centroid[1]);
+            object.syntheticPoints = completeObjectCloud(object, tableHeight, completionDistanceTop_, completionVoxelSize_, completionMaxPoints_);
+            ROS_INFO("[GraspObjects] Object %d: %d synthetic points added down to the table at %f", object.label,
+                     object.syntheticPoints, tableHeight);
+            if (publishAddedPoints)
+            {
+                *allPoints += object.object_cloud;
+            }
 
-                for (unsigned int idx = 0; idx < detectedObjects_.size(); idx++)
-                {
+            std::vector<int> sampledIndices;
+            if (stratifiedSubsampling_)
+            {
+                voxelStratifiedSubsample(object.object_cloud, subsamplePoints_, sampledIndices);
+            }
+            else
+            {
+                sampledIndices.resize(object.object_cloud.size());
+                std::iota(sampledIndices.begin(), sampledIndices.end(), 0);
+            }
+
+            SuperqModel::PointCloud point_cloud;
+            if (!pclPointCloudToSuperqPointCloud(object.object_cloud, sampledIndices, point_cloud))
+            {
+                ROS_WARN("[GraspObjects] Object %d has too few points for a superquadric, skipping it.", object.label);
+                continue;
+            }
+            ROS_INFO("pointCloud points: %d", point_cloud.n_points);
+            std::vector<SuperqModel::Superquadric> superqs;
+            const SuperquadricPrior *prior = findPrior(object.object_cloud);
+            // A single fit per object keeps the fit budget a bound on the object's fitting time
+            bool budgetReached = getSuperquadricFromPointCloud(point_cloud, prior != nullptr ? prior->objectClass : object_class_, superqs);
+            if (superqs.empty())
+            {
+                ROS_WARN("[GraspObjects] No superquadric fitted for object %d, skipping it.", object.label);
+                continue;
+            }
+            // Grasps computed on a fit that does not look like its category would miss the object
+            if (prior != nullptr && !isPlausibleSuperquadric(*prior, superqs[0]))
+            {
+                ROS_WARN("[GraspObjects] Superquadric of object %d does not match its category prior, skipping it.", object.label);
+                continue;
+            }
+            sharon_msgs::Superquadric superquadric;
+            auto params = superqs[0].getSuperqParams();
+            superquadric.id = object.label;
+            superquadric.budget_reached = budgetReached;
+            superquadric.a1 = params[0];
+            superquadric.a2 = params[1];
+            superquadric.a3 = params[2];
+            superquadric.e1 = params[3];
+            superquadric.e2 = params[4];
+            superquadric.x = params[5];
+            superquadric.y = params[6];
+            superquadric.z = params[7];
+            superquadric.roll = params[8];
+            superquadric.pitch = params[9];
+            superquadric.yaw = params[10];
+
+            ObjectSuperquadric objectSuperquadric;
+            objectSuperquadric.label = object.label;
+            objectSuperquadric.superqs = superqs;
+
+            // This is only for visulazition of the superquadrics
+            if (publishSuperqsCloud)
+            {
+                pcl::PointCloud<pcl::PointXYZRGBA>::Ptr auxCloudSuperquadric(new pcl::PointCloud<pcl::PointXYZRGBA>);
+                createPointCloudFromSuperquadric(superqs, auxCloudSuperquadric, object);
+                *cloudSuperquadric += *auxCloudSuperquadric;
+                objectSuperquadric.cloud = *auxCloudSuperquadric;
+            }
+
+            scene.objects.push_back(objectSuperquadric);
+            scene.superquadrics.superquadrics.push_back(superquadric);
+        }
+        if (publishSuperqsCloud)
+        {
+            debugPublisher_.publishCloud<pcl::PointXYZRGBA>("/grasp_objects/superquadrics_cloud", cloudSuperquadric, "/base_footprint");
+        }
+        if (publishAddedPoints)
+        {
+            debugPublisher_.publishCloud<pcl::PointXYZRGB>("/added_points", allPoints, "/base_footprint");
+        }
+        return true;
+    }
+
+    bool GraspObjects::publishFrame(PerceptionFrame &frame)
+    {
+        std::shared_ptr<SceneSnapshot> scene = frame.scene;
+        if (!frame.labeledCloud->points.empty())
+        {
+            superquadricsPublisher_.publish(scene->superquadrics);
 
-                    addPointsToObjectCloud(idx, 0.6, 0.02, 0.0005);
-                    // for(int i=0; i<detectedObjects_[idx].object_cloud.points.size(); i++){
-                    //     pcl::PointXYZRGB p = detectedObjects_[idx].object_cloud.points[i];
-                    //     allPoints->points.push_back(p);
-                    // }
-
-                    SuperqModel::PointCloud point_cloud;
-                    pclPointCloudToSuperqPointCloud(detectedObjects_[idx].object_cloud, point_cloud);
-                    ROS_INFO("pointCloud points: %d", point_cloud.n_points);
-                    std::vector<SuperqModel::Superquadric> superqs;
-                    getSuperquadricFromPointCloud(point_cloud, superqs);
-                    sharon_msgs::Superquadric superquadric;
-                    auto params = superqs[0].getSuperqParams();
-                    superquadric.id = detectedObjects_[idx].label;
-                    superquadric.a1 = params[0];
-                    superquadric.a2 = params[1];
-                    superquadric.a3 = params[2];
-                    superquadric.e1 = params[3];
-                    superquadric.e2 = params[4];
-                    superquadric.x = params[5];
-                    superquadric.y = params[6];
-                    superquadric.z = params[7];
-                    superquadric.roll = params[8];
-                    superquadric.pitch = params[9];
-                    superquadric.yaw = params[10];
-
-                    pcl::PointCloud<pcl::PointXYZRGBA>::Ptr auxCloudSuperquadric(new pcl::PointCloud<pcl::PointXYZRGBA>);
-
-                    // This is only for visulazition of the superquadrics
-                    createPointCloudFromSuperquadric(superqs, auxCloudSuperquadric, idx);
-                    *cloudSuperquadric += *auxCloudSuperquadric;
-
-                    ObjectSuperquadric objectSuperquadric;
-                    objectSuperquadric.label = detectedObjects_[idx].label;
-                    objectSuperquadric.superqs = superqs;
-                    objectSuperquadric.cloud = *auxCloudSuperquadric;
-
-                    superquadricObjects_.push_back(objectSuperquadric);
-                    superquadricsMsg_.superquadrics.push_back(superquadric);
+            // The 2d boxes are computed once per scene, services and subscribers get this result
+            bool bboxesFromLabels = bboxSource_ == "label_image";
+            bool publishMarkers = debugPublisher_.wants("/grasp_objects/bbox3d");
+            if (!bboxesFromLabels || publishMarkers)
+            {
+                sharon_msgs::BoundingBoxes projectedBoxes;
+                projectedBoxes.header = frame.depth->header;
+                visualization_msgs::MarkerArray markerArray;
+                computeBoundingBoxes2D(scene->superquadrics, frame.cameraFromBase, projectedBoxes, publishMarkers ? &markerArray : nullptr);
+                if (publishMarkers)
+                {
+                    debugPublisher_.publish("/grasp_objects/bbox3d", markerArray);
+                }
+                if (!bboxesFromLabels)
+                {
+                    scene->boundingBoxes = projectedBoxes;
+                    boundingBoxesPublisher_.publish(scene->boundingBoxes);
                 }
-                // Convert to ROS data type
-                sensor_msgs::PointCloud2 pcOutSupeqs;
-                pcl::PCLPointCloud2 *cloudAux = new pcl::PCLPointCloud2;
-
-                pcl::toPCLPointCloud2(*cloudSuperquadric, *cloudAux);
-                pcl_conversions::moveFromPCL(*cloudAux, pcOutSupeqs);
-                pcOutSupeqs.header.frame_id = "/base_footprint";
-                outPointCloudSuperqsPublisher_.publish(pcOutSupeqs);
-                superquadricsPublisher_.publish(superquadricsMsg_);
-
-                // Convert to ROS data type
-                // pcl::PCLPointCloud2 *allPointsPC2 = new pcl::PCLPointCloud2;
-                // pcl::toPCLPointCloud2(*allPoints, *allPointsPC2);
-                // sensor_msgs::PointCloud2 pcOutAllPoints;
-                // pcl_conversions::moveFromPCL(*allPointsPC2, pcOutAllPoints);
-                // pcOutAllPoints.header.frame_id = "/base_footprint";
-
-                // outPointCloudAddedPointsPublisher_.publish(pcOutAllPoints);
             }
         }
+        publishSceneSnapshot(scene);
+        scheduleGraspPrecomputation(*scene);
+        updateSceneStability(*scene, frame);
+        return true;
+    }
+
+    void GraspObjects::updateSceneStability(const SceneSnapshot &scene, const PerceptionFrame &frame)
+    {
+        bool wasStable = stabilityDetector_.stable();
+        if (resetStability_.exchange(false))
+            stabilityDetector_.reset();
+        std::vector<Eigen::VectorXd> objects;
+        objects.reserve(scene.objects.size());
+        for (const auto &object : scene.objects)
+            if (!object.superqs.empty())
+                objects.push_back(object.superqs[0].getSuperqParams());
+        bool stable = stabilityDetector_.update(objects);
+        {
+            std::lock_guard<std::mutex> lock(mtxComputeScene_);
+            if (sceneGoalActive_ && frame.sequence >= sceneGoalFirstFrame_)
+            {
+                sceneGoalStable_ = stable;
+                sceneGoalConfidence_ = stabilityDetector_.confidence();
+            }
+        }
+
+        // The topic is latched, so only the changes are published
+        if (stable == wasStable)
+            return;
+        sharon_msgs::SceneStability msg;
+        msg.header.stamp = frame.depth->header.stamp;
+        msg.header.frame_id = "base_footprint";
+        msg.stable = stable;
+        msg.confidence = stabilityDetector_.confidence();
+        msg.consistent_frames = stabilityDetector_.consistentFrames();
+        msg.objects = objects.size();
+        msg.scene_version = scene.version;
+        sceneStabilityPublisher_.publish(msg);
+        ROS_INFO("[GraspObjects] Scene %lu stable: %d, confidence %f", (unsigned long)scene.version, stable, msg.confidence);
+    }
+
+    void GraspObjects::publishPipelineMetrics(const ros::WallTimerEvent &event)
+    {
+        PipelineMetrics metrics;
+        pipeline_.metrics(metrics);
+        if (pipelineMetricsPublisher_.getNumSubscribers() == 0)
+            return;
+        sharon_msgs::PipelineMetrics msg;
+        msg.header.stamp = ros::Time::now();
+        msg.period = metrics.period;
+        msg.stages = metrics.stages;
+        msg.occupancy = metrics.occupancy;
+        msg.queue_depth = metrics.queueDepth;
+        msg.queue_capacity = metrics.queueCapacity;
+        msg.frames = metrics.frames;
+        pipelineMetricsPublisher_.publish(msg);
     }
 
-    void GraspObjects::addPointsToObjectCloud(int idx, float minHeight, float distanceTop, float distanceBtwPoints)
+    Eigen::Vector4f GraspObjects::tablePlane(const pcl::ModelCoefficients &coefficients)
     {
+        if (coefficients.values.size() != 4 || std::abs(coefficients.values[2]) <= 0.9)
+            return Eigen::Vector4f(0, 0, 1, -defaultTableHeight_);
+        Eigen::Vector4f plane(coefficients.values[0], coefficients.values[1], coefficients.values[2], coefficients.values[3]);
+        return plane[2] < 0 ? Eigen::Vector4f(-plane) : plane;
+    }
 
+    float GraspObjects::tableHeightAt(const Eigen::Vector4f &tablePlane, float x, float y)
+    {
+        return -(tablePlane[0] * x + tablePlane[1] * y + tablePlane[3]) / tablePlane[2];
+    }
+
+    int GraspObjects::completeObjectCloud(Object &object, float tableHeight, float distanceTop, float voxelSize, int maxPoints)
+    {
+        pcl::PointCloud<pcl::PointXYZRGB> &cloud = object.object_cloud;
         pcl::PointXYZRGB minPt, maxPt;
-        pcl::getMinMax3D(detectedObjects_[idx].object_cloud, minPt, maxPt);
-        std::cout << "Max z: " << maxPt.z << std::endl;
-        std::cout << "Min z: " << minPt.z << std::endl;
-        std::vector<int> indexes;
-        if (maxPt.z > minHeight)
+        pcl::getMinMax3D(cloud, minPt, maxPt);
+        if (maxPt.z <= tableHeight + voxelSize)
+            return 0;
+
+        // Top of the object on an xy grid
+        std::map<std::pair<int, int>, pcl::PointXYZRGB> topCells;
+        for (const pcl::PointXYZRGB &p : cloud.points)
         {
-            for (int i = 0; i < detectedObjects_[idx].object_cloud.size(); i++)
+            if (p.z >= (maxPt.z - distanceTop))
             {
-                pcl::PointXYZRGB p = detectedObjects_[idx].object_cloud.points[i];
-                if (p.z >= (maxPt.z - distanceTop))
+                std::pair<int, int> cell((int)std::floor(p.x / voxelSize), (int)std::floor(p.y / voxelSize));
+                if (topCells.find(cell) == topCells.end())
                 {
-                    indexes.push_back(i);
-                    // std::cout << "we have a point z: " << p.z << std::endl;
+                    pcl::PointXYZRGB q = p;
+                    q.x = (cell.first + 0.5f) * voxelSize;
+                    q.y = (cell.second + 0.5f) * voxelSize;
+                    topCells[cell] = q;
                 }
             }
-            for (int j = 0; j < indexes.size(); j++)
+        }
+
+        // Only the cells on the border of the top need side points
+        std::vector<const pcl::PointXYZRGB *> boundary;
+        for (const auto &cell : topCells)
+        {
+            int x = cell.first.first, y = cell.first.second;
+            if (!topCells.count({x + 1, y}) || !topCells.count({x - 1, y}) || !topCells.count({x, y + 1}) || !topCells.count({x, y - 1}))
+                boundary.push_back(&cell.second);
+        }
+
+        float height = maxPt.z - tableHeight;
+        int nBottom = topCells.size();
+        int nBoundary = std::max((int)boundary.size(), 1);
+        int levels = std::max((int)(height / voxelSize), 1);
+        if (nBottom + nBoundary * levels > maxPoints)
+        {
+            levels = std::max((maxPoints - nBottom) / nBoundary, 1);
+        }
+        float step = height / levels;
+
+        // If the top alone is too large for the budget, keep every stride-th synthetic point
+        int total = nBottom + nBoundary * levels;
+        int stride = std::max((total + maxPoints - 1) / std::max(maxPoints, 1), 1);
+        int emitted = 0, added = 0;
+        auto emit = [&](pcl::PointXYZRGB p, float z)
+        {
+            if (emitted++ % stride == 0 && added < maxPoints)
             {
-                pcl::PointXYZRGB auxp;
-                pcl::PointXYZRGB p = detectedObjects_[idx].object_cloud.points[indexes[j]];
-                auxp.x = p.x;
-                auxp.y = p.y;
-                auxp.z = p.z;
-                auxp.r = p.r;
-                auxp.g = p.g;
-                auxp.b = p.b;
-                auxp.z += 20*distanceBtwPoints;
-                while (auxp.z >= minHeight)
-                {
-                    detectedObjects_[idx].object_cloud.points.push_back(auxp);
-                    auxp.z -= distanceBtwPoints;
-                }
+                p.z = z;
+                cloud.points.push_back(p);
+                added++;
             }
+        };
+
+        for (const pcl::PointXYZRGB *p : boundary)
+        {
+            for (int level = 1; level <= levels; level++)
+                emit(*p, maxPt.z - level * step);
+        }
+        for (const auto &cell : topCells)
+        {
+            emit(cell.second, tableHeight);
         }
+
+        cloud.width = cloud.points.size();
+        cloud.height = 1;
+        return added;
     }
 
     // void GraspObjects::pointCloudCallback(const sensor_msgs::PointCloud2ConstPtr &pointCloud_msg)
@@ -1041,112 +1697,22 @@ namespace grasp_objects
         ROS_INFO("[GraspObjects] Principal point: (%f, %f)", principalPointX_, principalPointY_);
     }
 
-    void GraspObjects::createPointCloudFromSuperquadric(const std::vector<SuperqModel::Superquadric> &superqs, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloudSuperquadric, int indexDetectedObjects)
+    void GraspObjects::createPointCloudFromSuperquadric(const std::vector<SuperqModel::Superquadric> &superqs, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr &cloudSuperquadric,
+                                                        const Object &object)
     {
-        double step = 0.005;
-        auto params = superqs[0].getSuperqParams();
-
-        std::cout << "a0: " << params[0] << " a1: " << params[1] << " a2: " << params[2] << std::endl;
-
-        for (double x = 0; x <= params[0]; x += step)
+        const pcl::PointXYZRGB &color = object.object_cloud.points[0];
+        for (const SuperqModel::Superquadric &superq : superqs)
         {
-            for (double y = 0; y <= params[1]; y += step)
-            {
-                for (double z = 0; z <= params[2]; z += step)
-                {
-                    double f = pow(abs(pow(abs(x / params[0]), 2.0 / params[4]) + pow(abs(y / params[1]), 2.0 / params[4])), params[4] / params[3]) + pow(abs(z / params[2]), 2.0 / params[3]);
-                    if (f <= 1.0)
-                    {
-                        pcl::PointXYZRGBA p;
-
-                        p.x = x;
-                        p.y = y;
-                        p.z = z;
-                        p.r = detectedObjects_[indexDetectedObjects].object_cloud.points[0].r;
-                        p.g = detectedObjects_[indexDetectedObjects].object_cloud.points[0].g;
-                        p.b = detectedObjects_[indexDetectedObjects].object_cloud.points[0].b;
-                        cloudSuperquadric->push_back(*(pcl::PointXYZRGBA *)(&p));
-
-                        p.z = -z;
-                        cloudSuperquadric->push_back(*(pcl::PointXYZRGBA *)(&p));
-
-                        p.x = -x;
-                        p.y = y;
-                        p.z = z;
-                        cloudSuperquadric->push_back(*(pcl::PointXYZRGBA *)(&p));
-                        p.z = -z;
-                        cloudSuperquadric->push_back(*(pcl::PointXYZRGBA *)(&p));
-
-                        p.x = x;
-                        p.y = -y;
-                        p.z = z;
-                        cloudSuperquadric->push_back(*(pcl::PointXYZRGBA *)(&p));
-                        p.z = -z;
-                        cloudSuperquadric->push_back(*(pcl::PointXYZRGBA *)(&p));
-
-                        p.x = -x;
-                        p.y = -y;
-                        p.z = z;
-                        cloudSuperquadric->push_back(*(pcl::PointXYZRGBA *)(&p));
-
-                        p.z = -z;
-                        cloudSuperquadric->push_back(*(pcl::PointXYZRGBA *)(&p));
-                    }
-                }
-            }
+            surfaceSampler_.sample(superq.getSuperqParams(), color.r, color.g, color.b, *cloudSuperquadric);
         }
-
-        Eigen::AngleAxisf rollAngle(params[8], Eigen::Vector3f::UnitZ());
-        Eigen::AngleAxisf yawAngle(params[9], Eigen::Vector3f::UnitY());
-        Eigen::AngleAxisf pitchAngle(params[10], Eigen::Vector3f::UnitZ());
-
-        Eigen::Quaternionf q = rollAngle * yawAngle * pitchAngle;
-        Eigen::Matrix3f rotationMatrix = q.matrix();
-
-        Eigen::Vector3f v(params[5], params[6], params[7]);
-        Eigen::Matrix4f transform = Eigen::Affine3f(Eigen::Translation3f(v)).matrix();
-
-        transform.block<3, 3>(0, 0) = rotationMatrix;
-        pcl::transformPointCloud(*cloudSuperquadric, *cloudSuperquadric, transform);
     }
 
-    bool GraspObjects::pclPointCloudToSuperqPointCloud(const pcl::PointCloud<pcl::PointXYZRGB> &object_cloud, SuperqModel::PointCloud &point_cloud)
+    bool GraspObjects::pclPointCloudToSuperqPointCloud(const pcl::PointCloud<pcl::PointXYZRGB> &object_cloud, const std::vector<int> &indices, SuperqModel::PointCloud &point_cloud)
     {
-        std::vector<std::vector<unsigned char>> acquired_colors;
-
-        // yarp::sig::Vector point(3);
-        std::vector<unsigned char> c;
-        c.resize(3);
-        std::deque<Eigen::Vector3d> eigen_points;
-
-        for (size_t idx = 0; idx < object_cloud.size(); idx++)
-        {
-            Eigen::Vector3d point(object_cloud[idx].x, object_cloud[idx].y, object_cloud[idx].z);
-
-            c[0] = object_cloud[idx].r;
-            c[1] = object_cloud[idx].g;
-            c[2] = object_cloud[idx].b;
-
-            eigen_points.push_back(point);
-            acquired_colors.push_back(c);
-        }
-
-        // for (size_t i = 0; i < acquired_points.size(); i++)
-        // {
-        //     eigen_points.push_back(yarp::eigen::toEigen(acquired_points[i]));
-        // }
-
-        if (eigen_points.size() >= minimumPoints_)
-        {
-            point_cloud.setPoints(eigen_points);
-            point_cloud.setColors(acquired_colors);
-            return true;
-        }
-        else
-            return false;
+        return superqAdapter_.toSuperqPointCloud(object_cloud, indices, minimumPoints_, point_cloud);
     }
 
-    void GraspObjects::getSuperquadricFromPointCloud(SuperqModel::PointCloud point_cloud, std::vector<SuperqModel::Superquadric> &superqs)
+    bool GraspObjects::getSuperquadricFromPointCloud(SuperqModel::PointCloud &point_cloud, const std::string &objectClass, std::vector<SuperqModel::Superquadric> &superqs)
     {
 
         /*  ------------------------------  */
@@ -1154,11 +1720,22 @@ namespace grasp_objects
         /*  ------------------------------  */
 
         ROS_INFO("[grasp_objects]: compute superq");
-        if (single_superq_ || object_class_ != "default")
+        bool budgetReached = false;
+        if (single_superq_ || objectClass != "default")
         {
-            ROS_INFO("!!!!!");
-            estim_.SetStringValue("object_class", object_class_);
+            estim_.SetStringValue("object_class", objectClass);
+            auto start = std::chrono::steady_clock::now();
             superqs = estim_.computeSuperq(point_cloud);
+            double used = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            // The estimator does not return the solver status. Ipopt stops once the wall time since its start exceeds max_wall_time,
+            // and this interval contains the solver run, so a fit cut off by Ipopt always gets here.
+            budgetReached = used >= maxFitTime_;
+            if (budgetReached)
+            {
+                ROS_WARN("[GraspObjects] Superquadric fit took %f s, budget of %f s reached. The fit may not have converged.", used, maxFitTime_);
+            }
         }
+        return budgetReached;
     }
 }
\ No newline at end of file
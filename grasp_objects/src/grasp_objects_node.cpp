@@ -13,11 +13,12 @@ int main(int argc, char** argv) {
   ros::init(argc, argv, "grasp_objects");
   ros::NodeHandle nodeHandle("~");
   grasp_objects::GraspObjects graspObjects(nodeHandle);
-  ros::Rate r(10);
-  while(ros::ok()){
 
-    ros::spinOnce();
-    r.sleep();
-  }
+  // The depth images are spun by GraspObjects on their own queue, these threads only serve the services and tf
+  int serviceThreads = 2;
+  ros::param::get("grasp_objects/service_threads", serviceThreads);
+  ros::AsyncSpinner spinner(serviceThreads);
+  spinner.start();
+  ros::waitForShutdown();
   return 0;
 }
\ No newline at end of file
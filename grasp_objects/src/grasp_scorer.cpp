@@ -0,0 +1,87 @@
+#include "grasp_objects/grasp_scorer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include <Eigen/Geometry>
+
+#include "grasp_objects/superquadric_kernels.hpp"
+
+namespace grasp_objects
+{
+    void GraspScorer::setParams(const GraspScoringParams &params)
+    {
+        params_ = params;
+    }
+
+    void GraspScorer::setShoulderPosition(const Eigen::Vector3f &shoulder)
+    {
+        shoulder_ = shoulder;
+    }
+
+    void GraspScorer::rank(const GraspCandidates &candidates, const Eigen::Vector3f &centerOfMass, const std::vector<Eigen::VectorXd> &neighbors,
+                           std::vector<int> &order, std::vector<float> &scores) const
+    {
+        int n = candidates.size();
+        float totalWeight = params_.approachWeight + params_.reachWeight + params_.clearanceWeight + params_.centerOfMassWeight;
+        if (totalWeight <= 0)
+            totalWeight = 1.0;
+
+        Eigen::Matrix3Xf fromShoulder = candidates.positions.colwise() - shoulder_;
+        Eigen::RowVectorXf reach = fromShoulder.colwise().norm();
+        Eigen::RowVectorXf alignment = (candidates.approaches.cwiseProduct(fromShoulder).colwise().sum().array() /
+                                        reach.array().max(1e-6f))
+                                           .matrix();
+        Eigen::Matrix3Xf fromCenter = candidates.positions.colwise() - centerOfMass;
+        Eigen::RowVectorXf along = candidates.approaches.cwiseProduct(fromCenter).colwise().sum();
+        Eigen::RowVectorXf lateral = (fromCenter - candidates.approaches * along.asDiagonal()).colwise().norm();
+
+        Eigen::ArrayXf score(n);
+        score = params_.approachWeight * (1.0f + alignment.array().transpose()) / 2.0f;
+        score += params_.reachWeight * (1.0f - (reach.array().transpose() - params_.preferredReach).abs() / params_.reachTolerance).max(0.0f);
+        score += params_.centerOfMassWeight * (1.0f - lateral.array().transpose() / params_.centerOfMassTolerance).max(0.0f);
+
+        // The gripper occupies the segment from the grasp point back along the approach axis, both ends in one SoA batch
+        Eigen::Matrix<float, Eigen::Dynamic, 3> ends(2 * n, 3);
+        ends.topRows(n) = candidates.positions.transpose();
+        ends.bottomRows(n) = (candidates.positions - params_.gripperLength * candidates.approaches).transpose();
+        Eigen::ArrayXf clearance = Eigen::ArrayXf::Constant(2 * n, params_.clearanceSaturation);
+        Eigen::ArrayXf distance(2 * n);
+        for (const Eigen::VectorXd &neighbor : neighbors)
+        {
+            kernels::radialDistance(kernels::makeShape(neighbor), ends.col(0).data(), ends.col(1).data(), ends.col(2).data(), distance.data(), 2 * n);
+            clearance = clearance.min(distance);
+        }
+        Eigen::ArrayXf gripperClearance = clearance.head(n).min(clearance.tail(n)).max(0.0f);
+        score += params_.clearanceWeight * gripperClearance / params_.clearanceSaturation;
+        score /= totalWeight;
+
+        std::vector<int> sorted(n);
+        std::iota(sorted.begin(), sorted.end(), 0);
+        std::stable_sort(sorted.begin(), sorted.end(), [&score](int a, int b) { return score[a] > score[b]; });
+
+        float cosHalfAngle = std::cos(params_.duplicateAngle / 2.0f);
+        order.clear();
+        scores.clear();
+        for (int i : sorted)
+        {
+            bool duplicate = false;
+            for (int k : order)
+            {
+                if ((candidates.positions.col(i) - candidates.positions.col(k)).norm() < params_.duplicateDistance &&
+                    std::abs(candidates.orientations.col(i).dot(candidates.orientations.col(k))) > cosHalfAngle)
+                {
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (!duplicate)
+            {
+                order.push_back(i);
+                scores.push_back(score[i]);
+            }
+        }
+    }
+}
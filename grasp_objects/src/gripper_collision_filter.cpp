@@ -0,0 +1,112 @@
+#include "grasp_objects/gripper_collision_filter.hpp"
+
+#include <Eigen/Geometry>
+
+#include "grasp_objects/superquadric_kernels.hpp"
+
+namespace grasp_objects
+{
+    GripperCollisionFilter::GripperCollisionFilter()
+    {
+        // Fingers at the maximum opening of 9 cm, closing along z as in the candidates of GraspCandidateGenerator, palm behind them along -x
+        boxes_ = {{Eigen::Vector3f(0.0, 0.0, 0.0525), Eigen::Vector3f(0.035, 0.015, 0.0075)},
+                  {Eigen::Vector3f(0.0, 0.0, -0.0525), Eigen::Vector3f(0.035, 0.015, 0.0075)},
+                  {Eigen::Vector3f(-0.085, 0.0, 0.0), Eigen::Vector3f(0.05, 0.03, 0.06)}};
+        samplePoints();
+    }
+
+    void GripperCollisionFilter::setBoxes(const std::vector<GripperBox> &boxes)
+    {
+        boxes_ = boxes;
+        samplePoints();
+    }
+
+    void GripperCollisionFilter::setPointsPerEdge(int pointsPerEdge)
+    {
+        pointsPerEdge_ = std::max(pointsPerEdge, 2);
+        samplePoints();
+    }
+
+    void GripperCollisionFilter::setTableMargin(float tableMargin)
+    {
+        tableMargin_ = tableMargin;
+    }
+
+    void GripperCollisionFilter::samplePoints()
+    {
+        int perBox = pointsPerEdge_ * pointsPerEdge_ * pointsPerEdge_;
+        points_.resize(3, perBox * boxes_.size());
+        Eigen::ArrayXf steps = Eigen::ArrayXf::LinSpaced(pointsPerEdge_, -1.0, 1.0);
+        int col = 0;
+        for (const GripperBox &box : boxes_)
+        {
+            for (int i = 0; i < pointsPerEdge_; i++)
+                for (int j = 0; j < pointsPerEdge_; j++)
+                    for (int k = 0; k < pointsPerEdge_; k++)
+                        points_.col(col++) = box.center + box.halfExtents.cwiseProduct(Eigen::Vector3f(steps[i], steps[j], steps[k]));
+        }
+        radius_ = points_.cols() > 0 ? points_.colwise().norm().maxCoeff() : 0.0f;
+    }
+
+    void GripperCollisionFilter::filter(const GraspCandidates &candidates, const std::vector<Eigen::VectorXd> &neighbors, const Eigen::Vector4f &tablePlane,
+                                        std::vector<int> &free) const
+    {
+        struct Neighbor
+        {
+            kernels::SuperquadricShape shape;
+            Eigen::Vector3f center;
+            float radius;
+        };
+        std::vector<Neighbor> shapes;
+        shapes.reserve(neighbors.size());
+        for (const Eigen::VectorXd &params : neighbors)
+        {
+            Neighbor n;
+            n.shape = kernels::makeShape(params);
+            n.center = Eigen::Vector3f(params[5], params[6], params[7]);
+            // A superquadric is inside the box of its semi-axes
+            n.radius = Eigen::Vector3f(params[0], params[1], params[2]).norm();
+            shapes.push_back(n);
+        }
+
+        Eigen::Vector3f normal = tablePlane.head<3>();
+        float normalNorm = normal.norm();
+        free.clear();
+        free.reserve(candidates.size());
+        // Gripper points of a candidate in SoA layout, one column per coordinate
+        Eigen::Matrix<float, Eigen::Dynamic, 3> world(points_.cols(), 3);
+        Eigen::ArrayXf f(points_.cols());
+        for (int i = 0; i < candidates.size(); i++)
+        {
+            Eigen::Matrix3f rotation = Eigen::Quaternionf(candidates.orientations.col(i)).toRotationMatrix();
+            Eigen::Vector3f position = candidates.positions.col(i);
+
+            // Points above the table have a positive signed distance
+            bool collides = false;
+            if (normalNorm > 0)
+            {
+                Eigen::RowVectorXf heights = (normal.transpose() * rotation) * points_;
+                float origin = (normal.dot(position) + tablePlane[3]);
+                collides = ((heights.array() + origin) / normalNorm < tableMargin_).any();
+            }
+
+            bool transformed = false;
+            for (size_t k = 0; k < shapes.size() && !collides; k++)
+            {
+                const Neighbor &n = shapes[k];
+                if ((position - n.center).norm() > radius_ + n.radius)
+                    continue;
+                if (!transformed)
+                {
+                    world.noalias() = points_.transpose() * rotation.transpose();
+                    world.rowwise() += position.transpose();
+                    transformed = true;
+                }
+                kernels::insideOutside(n.shape, world.col(0).data(), world.col(1).data(), world.col(2).data(), f.data(), f.size());
+                collides = (f < 1.0f).any();
+            }
+            if (!collides)
+                free.push_back(i);
+        }
+    }
+}
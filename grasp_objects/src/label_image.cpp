@@ -0,0 +1,133 @@
+#include "grasp_objects/label_image.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace grasp_objects
+{
+    namespace
+    {
+        int64_t cellKey(const Eigen::Vector3f &p, float invCell)
+        {
+            // 21 bits per axis, enough for any workspace at millimeter cells
+            int64_t x = (int64_t)std::floor(p[0] * invCell) & 0x1fffff;
+            int64_t y = (int64_t)std::floor(p[1] * invCell) & 0x1fffff;
+            int64_t z = (int64_t)std::floor(p[2] * invCell) & 0x1fffff;
+            return (x << 42) | (y << 21) | z;
+        }
+
+        float depthAt(const cv::Mat &depth, int u, int v)
+        {
+            if (depth.type() == CV_16UC1)
+                return depth.at<uint16_t>(v, u) * 0.001f;
+            return depth.at<float>(v, u);
+        }
+    }
+
+    void buildLabelImage(const pcl::PointCloud<pcl::PointXYZL> &cloud, const cv::Mat &depth, const Eigen::Matrix4f &cameraFromBase,
+                         const CameraIntrinsics &intrinsics, float voxelSize, cv::Mat &labelImage)
+    {
+        labelImage.create(intrinsics.height, intrinsics.width, CV_16UC1);
+        labelImage.setTo(0);
+        if (depth.rows != intrinsics.height || depth.cols != intrinsics.width || (depth.type() != CV_32FC1 && depth.type() != CV_16UC1))
+            return;
+
+        // Any two points of the same leaf are closer than its diagonal, every cell of that size only needs to look at its neighbors
+        const float radius = voxelSize * std::sqrt(3.0f);
+        const float invCell = 1.0f / radius;
+        const Eigen::Matrix3f rotation = cameraFromBase.block<3, 3>(0, 0);
+        const Eigen::Vector3f translation = cameraFromBase.block<3, 1>(0, 3);
+
+        // Each labeled point is stored in its cell and the 26 around it, so a pixel finds its candidates with one lookup.
+        // The image window of the labeled points bounds the pixels that are back-projected.
+        std::unordered_map<int64_t, std::vector<int>> cells;
+        int minU = intrinsics.width, minV = intrinsics.height, maxU = -1, maxV = -1;
+        for (int i = 0; i < (int)cloud.size(); i++)
+        {
+            const pcl::PointXYZL &point = cloud.points[i];
+            if (point.label == 0)
+                continue;
+            Eigen::Vector3f p = point.getVector3fMap();
+            for (int dx = -1; dx <= 1; dx++)
+                for (int dy = -1; dy <= 1; dy++)
+                    for (int dz = -1; dz <= 1; dz++)
+                        cells[cellKey(p + radius * Eigen::Vector3f(dx, dy, dz), invCell)].push_back(i);
+
+            Eigen::Vector3f c = rotation * p + translation;
+            if (c[2] <= 0)
+                continue;
+            int u = (int)(c[0] * intrinsics.focalLengthX / c[2] + intrinsics.principalPointX);
+            int v = (int)(c[1] * intrinsics.focalLengthY / c[2] + intrinsics.principalPointY);
+            int margin = (int)std::ceil(radius * intrinsics.focalLengthX / c[2]);
+            minU = std::min(minU, u - margin);
+            maxU = std::max(maxU, u + margin);
+            minV = std::min(minV, v - margin);
+            maxV = std::max(maxV, v + margin);
+        }
+        minU = std::max(minU, 0);
+        minV = std::max(minV, 0);
+        maxU = std::min(maxU, intrinsics.width - 1);
+        maxV = std::min(maxV, intrinsics.height - 1);
+
+        const Eigen::Matrix3f baseRotation = rotation.transpose();
+        const Eigen::Vector3f baseTranslation = -baseRotation * translation;
+        const float radiusSquared = radius * radius;
+        for (int v = minV; v <= maxV; v++)
+        {
+            uint16_t *labelRow = labelImage.ptr<uint16_t>(v);
+            for (int u = minU; u <= maxU; u++)
+            {
+                float z = depthAt(depth, u, v);
+                if (!std::isfinite(z) || z <= 0)
+                    continue;
+                // Same back-projection as depth_image_proc, the point of this pixel in the cloud frame
+                Eigen::Vector3f c((u - intrinsics.principalPointX) * z / intrinsics.focalLengthX,
+                                  (v - intrinsics.principalPointY) * z / intrinsics.focalLengthY, z);
+                Eigen::Vector3f p = baseRotation * c + baseTranslation;
+                auto it = cells.find(cellKey(p, invCell));
+                if (it == cells.end())
+                    continue;
+                float best = radiusSquared;
+                uint32_t label = 0;
+                for (int i : it->second)
+                {
+                    float d = (cloud.points[i].getVector3fMap() - p).squaredNorm();
+                    if (d <= best)
+                    {
+                        best = d;
+                        label = cloud.points[i].label;
+                    }
+                }
+                labelRow[u] = (uint16_t)std::min<uint32_t>(label, std::numeric_limits<uint16_t>::max());
+            }
+        }
+    }
+
+    void computeLabelBoxes(const cv::Mat &labelImage, std::map<uint16_t, LabelBox> &boxes)
+    {
+        boxes.clear();
+        for (int y = 0; y < labelImage.rows; y++)
+        {
+            const uint16_t *row = labelImage.ptr<uint16_t>(y);
+            for (int x = 0; x < labelImage.cols; x++)
+            {
+                if (row[x] == 0)
+                    continue;
+                auto it = boxes.find(row[x]);
+                if (it == boxes.end())
+                {
+                    boxes[row[x]] = {x, y, x, y, 1};
+                    continue;
+                }
+                LabelBox &box = it->second;
+                box.tlx = std::min(box.tlx, x);
+                box.brx = std::max(box.brx, x);
+                box.bry = y;
+                box.pixelCount++;
+            }
+        }
+    }
+}
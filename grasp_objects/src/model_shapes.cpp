@@ -0,0 +1,109 @@
+#include "grasp_objects/model_shapes.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+#include <dirent.h>
+#include <tinyxml2.h>
+
+namespace grasp_objects
+{
+    namespace
+    {
+        bool readNumbers(const tinyxml2::XMLElement *element, std::vector<float> &numbers)
+        {
+            numbers.clear();
+            if (element == nullptr || element->GetText() == nullptr)
+                return false;
+            std::istringstream stream(element->GetText());
+            float value;
+            while (stream >> value)
+                numbers.push_back(value);
+            return !numbers.empty();
+        }
+    }
+
+    bool readModelShape(const std::string &sdfPath, ModelShape &shape)
+    {
+        tinyxml2::XMLDocument document;
+        if (document.LoadFile(sdfPath.c_str()) != tinyxml2::XML_SUCCESS)
+            return false;
+        const tinyxml2::XMLElement *sdf = document.FirstChildElement("sdf");
+        const tinyxml2::XMLElement *model = sdf != nullptr ? sdf->FirstChildElement("model") : nullptr;
+        if (model == nullptr)
+            return false;
+
+        const tinyxml2::XMLElement *geometry = nullptr;
+        int collisions = 0;
+        for (const tinyxml2::XMLElement *link = model->FirstChildElement("link"); link != nullptr; link = link->NextSiblingElement("link"))
+        {
+            for (const tinyxml2::XMLElement *collision = link->FirstChildElement("collision"); collision != nullptr;
+                 collision = collision->NextSiblingElement("collision"))
+            {
+                geometry = collision->FirstChildElement("geometry");
+                collisions++;
+            }
+        }
+        if (collisions != 1 || geometry == nullptr)
+            return false;
+
+        std::vector<float> numbers;
+        if (const tinyxml2::XMLElement *box = geometry->FirstChildElement("box"))
+        {
+            if (!readNumbers(box->FirstChildElement("size"), numbers) || numbers.size() != 3)
+                return false;
+            shape.objectClass = "box";
+            shape.semiAxes = {numbers[0] / 2.0f, numbers[1] / 2.0f, numbers[2] / 2.0f};
+        }
+        else if (const tinyxml2::XMLElement *cylinder = geometry->FirstChildElement("cylinder"))
+        {
+            std::vector<float> length;
+            if (!readNumbers(cylinder->FirstChildElement("radius"), numbers) || !readNumbers(cylinder->FirstChildElement("length"), length))
+                return false;
+            shape.objectClass = "cylinder";
+            shape.semiAxes = {numbers[0], numbers[0], length[0] / 2.0f};
+        }
+        else
+        {
+            return false;
+        }
+        std::sort(shape.semiAxes.begin(), shape.semiAxes.end());
+        return true;
+    }
+
+    void readModelShapes(const std::string &modelsPath, std::vector<ModelShape> &shapes)
+    {
+        shapes.clear();
+        DIR *directory = opendir(modelsPath.c_str());
+        if (directory == nullptr)
+            return;
+        std::vector<std::string> names;
+        while (struct dirent *entry = readdir(directory))
+        {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..")
+                names.push_back(name);
+        }
+        closedir(directory);
+        std::sort(names.begin(), names.end());
+
+        for (const std::string &name : names)
+        {
+            ModelShape shape;
+            if (readModelShape(modelsPath + "/" + name + "/model.sdf", shape))
+            {
+                shape.name = name;
+                shapes.push_back(shape);
+            }
+        }
+    }
+
+    std::string modelCategory(const std::string &modelName)
+    {
+        size_t end = modelName.size();
+        while (end > 0 && std::isdigit((unsigned char)modelName[end - 1]))
+            end--;
+        return modelName.substr(0, end);
+    }
+}
@@ -0,0 +1,104 @@
+#include "grasp_objects/point_cloud_subsampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+#include <pcl/common/common.h>
+
+#define SUBSAMPLER_MAX_ITERATIONS 8
+#define SUBSAMPLER_MIN_FILL 0.9f
+
+namespace grasp_objects
+{
+    namespace
+    {
+        struct VoxelSample
+        {
+            int index;
+            float distance;
+        };
+
+        // Keeps, for each occupied voxel, the point closest to the voxel center
+        void sampleVoxels(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const Eigen::Vector3f &origin, float leaf,
+                          std::unordered_map<uint64_t, VoxelSample> &voxels)
+        {
+            voxels.clear();
+            for (int i = 0; i < (int)cloud.size(); i++)
+            {
+                Eigen::Vector3f p = cloud.points[i].getVector3fMap() - origin;
+                Eigen::Vector3f cell = (p / leaf).array().floor();
+                uint64_t key = ((uint64_t)cell[0] << 42) | ((uint64_t)cell[1] << 21) | (uint64_t)cell[2];
+                float distance = (p - (cell.array() + 0.5f).matrix() * leaf).squaredNorm();
+
+                auto it = voxels.find(key);
+                if (it == voxels.end())
+                {
+                    voxels[key] = {i, distance};
+                }
+                else if (distance < it->second.distance)
+                {
+                    it->second = {i, distance};
+                }
+            }
+        }
+    }
+
+    void voxelStratifiedSubsample(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, int budget, std::vector<int> &indices)
+    {
+        indices.clear();
+        if ((int)cloud.size() <= budget || budget <= 0)
+        {
+            indices.resize(cloud.size());
+            for (int i = 0; i < (int)cloud.size(); i++)
+                indices[i] = i;
+            return;
+        }
+
+        pcl::PointXYZRGB minPt, maxPt;
+        pcl::getMinMax3D(cloud, minPt, maxPt);
+        Eigen::Vector3f origin = minPt.getVector3fMap();
+        Eigen::Vector3f size = maxPt.getVector3fMap() - origin;
+
+        // Object points lie on a surface, so the occupied voxels grow with the area over the squared leaf size
+        float area = 2.0f * (size[0] * size[1] + size[1] * size[2] + size[0] * size[2]);
+        float leaf = std::max(std::sqrt(area / budget), 1e-4f);
+
+        // Only the visible side of an object is in the cloud, so the first leaf size may also leave much of the budget unused.
+        // The leaf size is refined both ways and the largest sample within the budget is kept
+        std::unordered_map<uint64_t, VoxelSample> voxels;
+        voxels.reserve(2 * budget);
+        float bestLeaf = 0.0f;
+        int bestSize = 0;
+        for (int iteration = 0; iteration < SUBSAMPLER_MAX_ITERATIONS; iteration++)
+        {
+            sampleVoxels(cloud, origin, leaf, voxels);
+            int size = voxels.size();
+            if (size <= budget && size > bestSize)
+            {
+                bestLeaf = leaf;
+                bestSize = size;
+            }
+            if (size <= budget && size >= SUBSAMPLER_MIN_FILL * budget)
+                break;
+            leaf *= std::sqrt((float)size / budget) * (size > budget ? 1.05f : 1.0f);
+        }
+        if (bestSize > 0 && bestLeaf != leaf)
+            sampleVoxels(cloud, origin, bestLeaf, voxels);
+
+        indices.reserve(voxels.size());
+        for (const auto &voxel : voxels)
+            indices.push_back(voxel.second.index);
+        std::sort(indices.begin(), indices.end());
+
+        // If the leaf size did not converge, drop voxels with a fixed stride to respect the budget
+        if ((int)indices.size() > budget)
+        {
+            std::vector<int> strided(budget);
+            for (int i = 0; i < budget; i++)
+                strided[i] = indices[(size_t)i * indices.size() / budget];
+            indices.swap(strided);
+        }
+    }
+}
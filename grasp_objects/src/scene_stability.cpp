@@ -0,0 +1,97 @@
+#include "grasp_objects/scene_stability.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace grasp_objects
+{
+    void SceneStabilityDetector::setParams(const SceneStabilityParams &params)
+    {
+        params_ = params;
+        params_.frames = std::max(params_.frames, 2);
+        reset();
+    }
+
+    void SceneStabilityDetector::reset()
+    {
+        previous_.clear();
+        consistentFrames_ = 0;
+        changes_.clear();
+    }
+
+    bool SceneStabilityDetector::update(const std::vector<Eigen::VectorXd> &objects)
+    {
+        float relativeChange = consistentFrames_ > 0 ? change(previous_, objects) : std::numeric_limits<float>::infinity();
+        if (relativeChange <= 1.0f)
+        {
+            consistentFrames_++;
+            changes_.push_back(relativeChange);
+            if ((int)changes_.size() > params_.frames - 1)
+                changes_.pop_front();
+        }
+        else
+        {
+            consistentFrames_ = 1;
+            changes_.clear();
+        }
+        previous_ = objects;
+        return stable();
+    }
+
+    bool SceneStabilityDetector::stable() const
+    {
+        return consistentFrames_ >= params_.frames;
+    }
+
+    int SceneStabilityDetector::consistentFrames() const
+    {
+        return consistentFrames_;
+    }
+
+    float SceneStabilityDetector::confidence() const
+    {
+        if (!stable() || changes_.empty())
+            return 0.0f;
+        return 1.0f - std::accumulate(changes_.begin(), changes_.end(), 0.0f) / changes_.size();
+    }
+
+    float SceneStabilityDetector::change(const std::vector<Eigen::VectorXd> &previous, const std::vector<Eigen::VectorXd> &current) const
+    {
+        if (previous.size() != current.size())
+            return std::numeric_limits<float>::infinity();
+
+        // Greedy matching by centroid, the scenes are small and consistent objects are much closer than their neighbors
+        std::vector<bool> matched(previous.size(), false);
+        float largest = 0.0f;
+        for (const Eigen::VectorXd &object : current)
+        {
+            int best = -1;
+            float bestDrift = std::numeric_limits<float>::infinity();
+            for (size_t k = 0; k < previous.size(); k++)
+            {
+                if (matched[k])
+                    continue;
+                float drift = (object.segment<3>(5) - previous[k].segment<3>(5)).norm();
+                if (drift < bestDrift)
+                {
+                    bestDrift = drift;
+                    best = k;
+                }
+            }
+            if (best < 0 || bestDrift > params_.maxCentroidDrift)
+                return std::numeric_limits<float>::infinity();
+            matched[best] = true;
+
+            // The estimator may swap the semi-axes of a symmetric object between frames
+            Eigen::Vector3d axes = object.head<3>(), previousAxes = previous[best].head<3>();
+            std::sort(axes.data(), axes.data() + 3);
+            std::sort(previousAxes.data(), previousAxes.data() + 3);
+            float axisDelta = (axes - previousAxes).cwiseAbs().maxCoeff();
+            float exponentDelta = (object.segment<2>(3) - previous[best].segment<2>(3)).cwiseAbs().maxCoeff();
+            largest = std::max({largest, bestDrift / params_.maxCentroidDrift, axisDelta / params_.maxAxisDelta,
+                                exponentDelta / params_.maxExponentDelta});
+        }
+        return largest;
+    }
+}
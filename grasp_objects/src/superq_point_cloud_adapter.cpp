@@ -0,0 +1,18 @@
+#include "grasp_objects/superq_point_cloud_adapter.hpp"
+
+namespace grasp_objects
+{
+    bool SuperqPointCloudAdapter::toSuperqPointCloud(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const std::vector<int> &indices, int minimumPoints,
+                                                     SuperqModel::PointCloud &point_cloud)
+    {
+        if ((int)indices.size() < minimumPoints)
+            return false;
+
+        points_.resize(indices.size());
+        for (size_t i = 0; i < indices.size(); i++)
+            points_[i] = cloud.points[indices[i]].getVector3fMap().cast<double>();
+        // The setter keeps the points and n_points of the estimator's cloud consistent
+        point_cloud.setPoints(points_);
+        return true;
+    }
+}
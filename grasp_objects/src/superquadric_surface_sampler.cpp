@@ -0,0 +1,84 @@
+#include "grasp_objects/superquadric_surface_sampler.hpp"
+
+#include <cmath>
+
+#include <Eigen/Geometry>
+
+#include "grasp_objects/superquadric_kernels.hpp"
+
+// Exponents are cached with this resolution, finer differences are not visible
+#define SAMPLER_EXPONENT_RESOLUTION 0.01
+#define SAMPLER_MAX_CACHED_SHAPES 64
+
+namespace grasp_objects
+{
+    SuperquadricSurfaceSampler::SuperquadricSurfaceSampler(int nPoints)
+    {
+        setNumberPoints(nPoints);
+    }
+
+    void SuperquadricSurfaceSampler::setNumberPoints(int nPoints)
+    {
+        // omega spans twice the angle of eta
+        nEta_ = std::max((int)std::sqrt(nPoints / 2.0), 2);
+        nOmega_ = 2 * nEta_;
+        cache_.clear();
+    }
+
+    const std::vector<Eigen::Vector3f> &SuperquadricSurfaceSampler::unitSurface(double e1, double e2)
+    {
+        std::pair<int, int> key(std::lround(e1 / SAMPLER_EXPONENT_RESOLUTION), std::lround(e2 / SAMPLER_EXPONENT_RESOLUTION));
+        auto it = cache_.find(key);
+        if (it != cache_.end())
+            return it->second;
+
+        if (cache_.size() >= SAMPLER_MAX_CACHED_SHAPES)
+            cache_.clear();
+
+        float qe1 = key.first * SAMPLER_EXPONENT_RESOLUTION;
+        float qe2 = key.second * SAMPLER_EXPONENT_RESOLUTION;
+        std::vector<Eigen::Vector3f> &surface = cache_[key];
+        surface.reserve(nEta_ * nOmega_);
+
+        // The surface is the product of a profile in eta and one in omega, so only their samples are raised
+        Eigen::ArrayXf eta = Eigen::ArrayXf::LinSpaced(nEta_, -M_PI / 2.0, M_PI / 2.0);
+        Eigen::ArrayXf omega = Eigen::ArrayXf::LinSpaced(nOmega_, -M_PI, M_PI - 2.0 * M_PI / nOmega_);
+        Eigen::ArrayXf ce = eta.cos(), se = eta.sin(), co = omega.cos(), so = omega.sin();
+        kernels::signedPow(ce.data(), qe1, ce.data(), nEta_);
+        kernels::signedPow(se.data(), qe1, se.data(), nEta_);
+        kernels::signedPow(co.data(), qe2, co.data(), nOmega_);
+        kernels::signedPow(so.data(), qe2, so.data(), nOmega_);
+        for (int i = 0; i < nEta_; i++)
+            for (int j = 0; j < nOmega_; j++)
+                surface.emplace_back(ce[i] * co[j], ce[i] * so[j], se[i]);
+        return surface;
+    }
+
+    void SuperquadricSurfaceSampler::sample(const Eigen::VectorXd &params, uint8_t r, uint8_t g, uint8_t b, pcl::PointCloud<pcl::PointXYZRGBA> &cloud)
+    {
+        const std::vector<Eigen::Vector3f> &surface = unitSurface(params[3], params[4]);
+
+        Eigen::AngleAxisf rollAngle(params[8], Eigen::Vector3f::UnitZ());
+        Eigen::AngleAxisf yawAngle(params[9], Eigen::Vector3f::UnitY());
+        Eigen::AngleAxisf pitchAngle(params[10], Eigen::Vector3f::UnitZ());
+        Eigen::Quaternionf q = rollAngle * yawAngle * pitchAngle;
+
+        // Scale and pose in a single linear map
+        Eigen::Matrix3f transform = q.matrix() * Eigen::Vector3f(params[0], params[1], params[2]).asDiagonal();
+        Eigen::Vector3f center(params[5], params[6], params[7]);
+
+        size_t offset = cloud.points.size();
+        cloud.points.resize(offset + surface.size());
+        for (size_t i = 0; i < surface.size(); i++)
+        {
+            pcl::PointXYZRGBA &p = cloud.points[offset + i];
+            p.getVector3fMap() = transform * surface[i] + center;
+            p.r = r;
+            p.g = g;
+            p.b = b;
+            p.a = 255;
+        }
+        cloud.width = cloud.points.size();
+        cloud.height = 1;
+    }
+}
@@ -0,0 +1,78 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "grasp_objects/grasp_candidate_generator.hpp"
+#include "grasp_candidates_reference.hpp"
+
+using namespace grasp_objects;
+
+namespace
+{
+    template <typename Function>
+    double microsecondsPerCall(Function function, int repetitions)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (int r = 0; r < repetitions; r++)
+            function();
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count() / repetitions;
+    }
+}
+
+/** Prints the time to build the grasp poses of typical objects with GraspCandidateGenerator against the KDL loops it replaced.
+ * Both include filling the geometry_msgs poses, the KDL loops also produce their duplicates.
+ */
+int main(int argc, char **argv)
+{
+    const int repetitions = 20000;
+    const float step = 0.025;
+    struct TestObject
+    {
+        std::string name;
+        Eigen::Vector3d semiAxes;
+    };
+    std::vector<TestObject> objects = {{"milk", Eigen::Vector3d(0.032, 0.037, 0.1125)},
+                                       {"cereal", Eigen::Vector3d(0.1, 0.04, 0.165)},
+                                       {"nesquik", Eigen::Vector3d(0.0642, 0.0642, 0.06985)}};
+
+    GraspCandidateGenerator generator(step, GRASP_FACE_ALL, 0.16);
+    std::printf("%d repetitions\n", repetitions);
+    std::printf("%-8s %11s %12s %11s %12s\n", "object", "candidates", "batched us", "kdl poses", "kdl us");
+    for (const TestObject &object : objects)
+    {
+        Eigen::VectorXd params(11);
+        params << object.semiAxes, 0.1, 0.1, 0.6, -0.1, 0.8, 0.3, 0.0, 0.0; // upright, z of the superquadric up
+        volatile double sink = 0;
+
+        GraspCandidates candidates;
+        geometry_msgs::PoseArray poses;
+        double batched = microsecondsPerCall([&]
+                                             {
+            generator.generate(params, candidates);
+            GraspCandidateGenerator::toPoseArray(candidates, poses);
+            sink = sink + poses.poses.size(); },
+                                             repetitions);
+
+        std::vector<KDL::Frame> frames;
+        geometry_msgs::PoseArray kdlPoses;
+        double kdl = microsecondsPerCall([&]
+                                         {
+            reference::graspPoses(params, step, 0.16, frames);
+            kdlPoses.poses.resize(frames.size());
+            for (size_t i = 0; i < frames.size(); i++)
+            {
+                geometry_msgs::Pose &pose = kdlPoses.poses[i];
+                pose.position.x = frames[i].p.x();
+                pose.position.y = frames[i].p.y();
+                pose.position.z = frames[i].p.z();
+                frames[i].M.GetQuaternion(pose.orientation.x, pose.orientation.y, pose.orientation.z, pose.orientation.w);
+            }
+            sink = sink + kdlPoses.poses.size(); },
+                                         repetitions);
+
+        std::printf("%-8s %11d %12.2f %11d %12.2f\n", object.name.c_str(), candidates.size(), batched, (int)frames.size(), kdl);
+    }
+    return 0;
+}
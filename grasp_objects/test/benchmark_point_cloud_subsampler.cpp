@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <SuperquadricLibModel/superquadricEstimator.h>
+
+#include "grasp_objects/point_cloud_subsampler.hpp"
+#include "grasp_objects/superq_point_cloud_adapter.hpp"
+#include "grasp_objects/superquadric_kernels.hpp"
+
+using namespace grasp_objects;
+
+namespace
+{
+    struct TestObject
+    {
+        std::string name;
+        std::string objectClass;
+        Eigen::Vector3f semiAxes;
+    };
+
+    /** Visible side of an object seen by a camera at the origin, like a depth image of it.
+     * Faces are kept with a probability that falls with their tilt away from the camera and the points have depth noise,
+     * so the density is uneven the way it is in the object clouds of the node. */
+    void makeObjectCloud(const TestObject &object, const Eigen::Matrix3f &rotation, const Eigen::Vector3f &center, std::mt19937 &rng,
+                         pcl::PointCloud<pcl::PointXYZRGB> &cloud)
+    {
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        std::normal_distribution<float> noise(0.0f, 0.002f);
+        const float step = 0.002f;
+        const Eigen::Vector3f &a = object.semiAxes;
+        cloud.clear();
+
+        auto addPoint = [&](const Eigen::Vector3f &surfacePoint, const Eigen::Vector3f &normal)
+        {
+            Eigen::Vector3f p = center + rotation * surfacePoint;
+            float visibility = (rotation * normal).dot(-p.normalized());
+            if (visibility <= 0.0f || uniform(rng) > visibility)
+                return;
+            p += p.normalized() * noise(rng);
+            pcl::PointXYZRGB point;
+            point.getVector3fMap() = p;
+            cloud.push_back(point);
+        };
+
+        if (object.objectClass == "cylinder")
+        {
+            int nAngles = std::ceil(2.0f * M_PI * a[0] / step);
+            for (int i = 0; i < nAngles; i++)
+            {
+                float angle = 2.0f * M_PI * i / nAngles;
+                Eigen::Vector3f normal(std::cos(angle), std::sin(angle), 0.0f);
+                for (float z = -a[2]; z <= a[2]; z += step)
+                    addPoint(Eigen::Vector3f(a[0] * normal[0], a[1] * normal[1], z), normal);
+            }
+            for (float x = -a[0]; x <= a[0]; x += step)
+                for (float y = -a[1]; y <= a[1]; y += step)
+                    if (x * x / (a[0] * a[0]) + y * y / (a[1] * a[1]) <= 1.0f)
+                        addPoint(Eigen::Vector3f(x, y, a[2]), Eigen::Vector3f::UnitZ());
+            return;
+        }
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int u = (axis + 1) % 3, v = (axis + 2) % 3;
+            for (float sign : {-1.0f, 1.0f})
+            {
+                Eigen::Vector3f normal = Eigen::Vector3f::Zero();
+                normal[axis] = sign;
+                for (float s = -a[u]; s <= a[u]; s += step)
+                {
+                    for (float t = -a[v]; t <= a[v]; t += step)
+                    {
+                        Eigen::Vector3f p;
+                        p[axis] = sign * a[axis];
+                        p[u] = s;
+                        p[v] = t;
+                        addPoint(p, normal);
+                    }
+                }
+            }
+        }
+    }
+
+    void randomSubsample(int nPoints, int budget, std::mt19937 &rng, std::vector<int> &indices)
+    {
+        indices.resize(nPoints);
+        std::iota(indices.begin(), indices.end(), 0);
+        if (nPoints <= budget)
+            return;
+        std::shuffle(indices.begin(), indices.end(), rng);
+        indices.resize(budget);
+        std::sort(indices.begin(), indices.end());
+    }
+
+    struct FitResult
+    {
+        double seconds = 0.0;
+        double residual = 0.0;  /**< mean radial distance of the whole object cloud to the fit, m*/
+        double axisError = 0.0; /**< largest error of the sorted semi-axes, m*/
+    };
+
+    FitResult fit(SuperqModel::SuperqEstimatorApp &estimator, SuperqPointCloudAdapter &adapter, const TestObject &object,
+                  const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const std::vector<int> &indices)
+    {
+        FitResult result;
+        SuperqModel::PointCloud pointCloud;
+        if (!adapter.toSuperqPointCloud(cloud, indices, 1, pointCloud))
+            return result;
+
+        estimator.SetStringValue("object_class", object.objectClass);
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<SuperqModel::Superquadric> superqs = estimator.computeSuperq(pointCloud);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        if (superqs.empty())
+            return result;
+
+        Eigen::VectorXd params = superqs[0].getSuperqParams();
+        kernels::SuperquadricShape shape = kernels::makeShape(params);
+        for (const pcl::PointXYZRGB &p : cloud.points)
+            result.residual += std::abs(kernels::radialDistance(shape, p.x, p.y, p.z));
+        result.residual /= cloud.size();
+
+        Eigen::Vector3f axes = params.head<3>().cast<float>(), expected = object.semiAxes;
+        std::sort(axes.data(), axes.data() + 3);
+        std::sort(expected.data(), expected.data() + 3);
+        result.axisError = (axes - expected).cwiseAbs().maxCoeff();
+        return result;
+    }
+}
+
+/** Compares the superquadric fits on randomly and voxel-stratified subsampled object clouds, with the estimator settings of the
+ * node. Fit time is wall time, the residual is measured on the whole cloud so it shows which parts of the object a subsample misses.
+ * Usage: grasp_objects_point_cloud_subsampler_benchmark [budget] [trials]
+ */
+int main(int argc, char **argv)
+{
+    const int budget = argc > 1 ? std::atoi(argv[1]) : 800;
+    const int trials = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    SuperqModel::SuperqEstimatorApp estimator;
+    SuperqPointCloudAdapter adapter;
+    estimator.SetNumericValue("tol", 1e-5);
+    estimator.SetIntegerValue("print_level", 0);
+    estimator.SetIntegerValue("optimizer_points", budget);
+    estimator.SetBoolValue("random_sampling", false);
+    estimator.SetBoolValue("merge_model", true);
+    estimator.SetIntegerValue("minimum_points", 400);
+    estimator.SetIntegerValue("fraction_pc", 4);
+    estimator.SetNumericValue("threshold_axis", 0.8);
+    estimator.SetNumericValue("threshold_section1", 0.7);
+    estimator.SetNumericValue("threshold_section2", 0.3);
+
+    // Collision sizes of the sharon_objects models
+    std::vector<TestObject> objects = {{"milk", "box", Eigen::Vector3f(0.032f, 0.037f, 0.1125f)},
+                                       {"cereal", "box", Eigen::Vector3f(0.04f, 0.1f, 0.165f)},
+                                       {"nesquik", "cylinder", Eigen::Vector3f(0.0642f, 0.0642f, 0.06985f)}};
+
+    std::printf("budget %d, %d trials per object, means over the trials\n", budget, trials);
+    std::printf("%-8s %7s %-11s %10s %13s %14s\n", "object", "points", "sampling", "fit ms", "residual mm", "axis error mm");
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> offset(-0.1f, 0.1f);
+    std::uniform_real_distribution<float> yaw(-0.6f, 0.6f);
+    for (const TestObject &object : objects)
+    {
+        FitResult randomMean, stratifiedMean;
+        int points = 0;
+        for (int trial = 0; trial < trials; trial++)
+        {
+            // Upright objects on a table in front of and below the camera, optical frame with z forward and y down
+            Eigen::Matrix3f rotation = (Eigen::AngleAxisf(M_PI / 2, Eigen::Vector3f::UnitX()) * Eigen::AngleAxisf(yaw(rng), Eigen::Vector3f::UnitZ())).toRotationMatrix();
+            pcl::PointCloud<pcl::PointXYZRGB> cloud;
+            makeObjectCloud(object, rotation, Eigen::Vector3f(offset(rng), 0.35f + offset(rng), 0.9f + offset(rng)), rng, cloud);
+            points += cloud.size();
+
+            std::vector<int> indices;
+            randomSubsample(cloud.size(), budget, rng, indices);
+            FitResult result = fit(estimator, adapter, object, cloud, indices);
+            randomMean.seconds += result.seconds / trials;
+            randomMean.residual += result.residual / trials;
+            randomMean.axisError += result.axisError / trials;
+
+            voxelStratifiedSubsample(cloud, budget, indices);
+            result = fit(estimator, adapter, object, cloud, indices);
+            stratifiedMean.seconds += result.seconds / trials;
+            stratifiedMean.residual += result.residual / trials;
+            stratifiedMean.axisError += result.axisError / trials;
+        }
+        std::printf("%-8s %7d %-11s %10.2f %13.2f %14.2f\n", object.name.c_str(), points / trials, "random", 1e3 * randomMean.seconds,
+                    1e3 * randomMean.residual, 1e3 * randomMean.axisError);
+        std::printf("%-8s %7d %-11s %10.2f %13.2f %14.2f\n", object.name.c_str(), points / trials, "stratified", 1e3 * stratifiedMean.seconds,
+                    1e3 * stratifiedMean.residual, 1e3 * stratifiedMean.axisError);
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "grasp_objects/superquadric_kernels.hpp"
+
+using namespace grasp_objects;
+
+namespace
+{
+    template <typename Function>
+    double nanosecondsPerPoint(Function function, int points, int repetitions)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (int r = 0; r < repetitions; r++)
+            function();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+        return ns / (double(points) * repetitions);
+    }
+}
+
+/** Prints the time per point of the batched kernels against the scalar loop they replace.
+ * Build with GRASP_OBJECTS_AVX2 to measure the AVX2 path, without it both columns run the scalar code.
+ */
+int main(int argc, char **argv)
+{
+    const int n = 4096;
+    const int repetitions = 500;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coordinate(-0.15f, 0.15f);
+    std::vector<float> x(n), y(n), z(n), out(n), gx(n), gy(n), gz(n);
+    for (int i = 0; i < n; i++)
+    {
+        x[i] = 0.5f + coordinate(rng);
+        y[i] = coordinate(rng);
+        z[i] = 0.8f + coordinate(rng);
+    }
+    Eigen::VectorXd params(11);
+    params << 0.03, 0.05, 0.1, 0.3, 0.7, 0.5, 0.0, 0.8, 0.3, 0.2, -0.4;
+    kernels::SuperquadricShape shape = kernels::makeShape(params);
+    volatile float sink = 0;
+
+#ifdef __AVX2__
+    std::printf("AVX2 build, %d points, %d repetitions\n", n, repetitions);
+#else
+    std::printf("Scalar build, %d points, %d repetitions\n", n, repetitions);
+#endif
+    std::printf("%-16s %12s %12s\n", "kernel", "batched ns", "scalar ns");
+
+    double batched = nanosecondsPerPoint([&]
+                                         { kernels::insideOutside(shape, x.data(), y.data(), z.data(), out.data(), n); sink = sink + out[0]; },
+                                         n, repetitions);
+    double scalar = nanosecondsPerPoint([&]
+                                        { for (int i = 0; i < n; i++) out[i] = kernels::detail::insideOutside(shape, x[i], y[i], z[i]); sink = sink + out[0]; },
+                                        n, repetitions);
+    std::printf("%-16s %12.2f %12.2f\n", "insideOutside", batched, scalar);
+
+    batched = nanosecondsPerPoint([&]
+                                  { kernels::radialDistance(shape, x.data(), y.data(), z.data(), out.data(), n); sink = sink + out[0]; },
+                                  n, repetitions);
+    scalar = nanosecondsPerPoint([&]
+                                 { for (int i = 0; i < n; i++) out[i] = kernels::detail::radialDistance(shape, x[i], y[i], z[i]); sink = sink + out[0]; },
+                                 n, repetitions);
+    std::printf("%-16s %12.2f %12.2f\n", "radialDistance", batched, scalar);
+
+    batched = nanosecondsPerPoint([&]
+                                  { kernels::gradient(shape, x.data(), y.data(), z.data(), gx.data(), gy.data(), gz.data(), n); sink = sink + gx[0]; },
+                                  n, repetitions);
+    scalar = nanosecondsPerPoint([&]
+                                 { for (int i = 0; i < n; i++) kernels::detail::gradient(shape, x[i], y[i], z[i], gx[i], gy[i], gz[i]); sink = sink + gx[0]; },
+                                 n, repetitions);
+    std::printf("%-16s %12.2f %12.2f\n", "gradient", batched, scalar);
+
+    batched = nanosecondsPerPoint([&]
+                                  { kernels::signedPow(x.data(), 0.7f, out.data(), n); sink = sink + out[0]; },
+                                  n, repetitions);
+    scalar = nanosecondsPerPoint([&]
+                                 { for (int i = 0; i < n; i++) out[i] = kernels::detail::signedPow(x[i], 0.7f); sink = sink + out[0]; },
+                                 n, repetitions);
+    std::printf("%-16s %12.2f %12.2f\n", "signedPow", batched, scalar);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef GRASP_OBJECTS_TEST_GRASP_CANDIDATES_REFERENCE_HPP
+#define GRASP_OBJECTS_TEST_GRASP_CANDIDATES_REFERENCE_HPP
+
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <kdl/frames.hpp>
+
+namespace grasp_objects
+{
+    namespace reference
+    {
+        /** Grasp of the loops GraspCandidateGenerator replaced, kept if its z axis is more than 20 degrees from the base x axis. */
+        inline void addGrasp(const KDL::Frame &frameObjectWrtWorld, const KDL::Frame &frameGraspingWrtObject, std::vector<KDL::Frame> &grasps)
+        {
+            KDL::Frame frameGraspingWrtWorld = frameObjectWrtWorld * frameGraspingWrtObject;
+            KDL::Vector unitz = frameGraspingWrtWorld.M.UnitZ();
+            KDL::Vector axesz(1, 0, 0);
+            float angle = atan2((unitz * axesz).Norm(), dot(unitz, axesz));
+            if (angle > 20 * M_PI / 180.0)
+                grasps.push_back(frameGraspingWrtWorld);
+        }
+
+        /** Faces normal to x, shared by both width branches of the original loops. */
+        inline void addFrontGrasps(const Eigen::VectorXd &params, float step, const KDL::Frame &frameObjectWrtWorld, std::vector<KDL::Frame> &grasps)
+        {
+            float yaxes = 1.0;
+            for (float xaxes = -1.0; xaxes <= 1.0; xaxes += 2)
+            {
+                KDL::Vector xobject(xaxes, 0, 0);
+                for (float y = 0; y <= params[1] / 2.0; y += step)
+                {
+                    KDL::Vector zobject(0, yaxes, 0.0);
+                    KDL::Vector yobject = zobject * xobject;
+                    KDL::Frame frameTCP = KDL::Frame(KDL::Rotation(xobject, yobject, zobject));
+                    frameTCP = KDL::Frame(KDL::Rotation::RotX(-M_PI / 2.0)) * frameTCP;
+                    for (int sign = 1; sign >= -1; sign -= 2)
+                    {
+                        KDL::Frame frameGraspingWrtObject = frameTCP;
+                        frameGraspingWrtObject.p = KDL::Vector(-xaxes * params[0], sign * y, 0);
+                        addGrasp(frameObjectWrtWorld, frameGraspingWrtObject, grasps);
+                    }
+                }
+            }
+        }
+
+        /** The KDL loops of GraspObjects::computeGraspingPosesObject before GraspCandidateGenerator, duplicates included. */
+        inline void graspPoses(const Eigen::VectorXd &params, float step, float maxObjectWidth, std::vector<KDL::Frame> &grasps)
+        {
+            grasps.clear();
+            Eigen::Quaternionf q = Eigen::AngleAxisf(params[8], Eigen::Vector3f::UnitZ()) * Eigen::AngleAxisf(params[9], Eigen::Vector3f::UnitY()) *
+                                   Eigen::AngleAxisf(params[10], Eigen::Vector3f::UnitZ());
+            KDL::Frame frameObjectWrtWorld(KDL::Rotation::Quaternion(q.x(), q.y(), q.z(), q.w()), KDL::Vector(params[5], params[6], params[7]));
+
+            if (2 * params[2] <= maxObjectWidth)
+            {
+                for (float yaxes = -1.0; yaxes <= 1.0; yaxes += 2)
+                {
+                    KDL::Vector yobject(0, yaxes, 0);
+                    for (float x = 0; x <= params[0] / 2.0; x += step)
+                    {
+                        KDL::Vector zobject(1.0, 0.0, 0.0);
+                        KDL::Vector xobject = yobject * zobject;
+                        KDL::Frame frameTCP = KDL::Frame(KDL::Rotation(xobject, yobject, zobject));
+                        frameTCP = KDL::Frame(KDL::Rotation::RotZ(M_PI / 2.0)) * frameTCP;
+                        frameTCP = KDL::Frame(KDL::Rotation::RotX(M_PI / 2.0)) * frameTCP;
+                        KDL::Frame frameGraspingWrtObject = frameTCP;
+                        for (int sign = 1.0; sign >= -1; sign -= 2.0)
+                        {
+                            frameGraspingWrtObject.p = KDL::Vector(sign * x, -yaxes * params[1], 0);
+                            addGrasp(frameObjectWrtWorld, frameGraspingWrtObject, grasps);
+                        }
+                    }
+                }
+                addFrontGrasps(params, step, frameObjectWrtWorld, grasps);
+            }
+
+            if (2 * params[1] <= maxObjectWidth)
+            {
+                for (float yaxes = -1.0; yaxes <= 1.0; yaxes += 2)
+                {
+                    KDL::Vector yobject(0, yaxes, 0);
+                    for (float x = 0; x <= params[0] / 2.0; x += step)
+                    {
+                        KDL::Vector zobject(0.0, 0.0, -1.0);
+                        KDL::Vector xobject = yobject * zobject;
+                        KDL::Frame frameTCP = KDL::Frame(KDL::Rotation(xobject, yobject, zobject));
+                        frameTCP = KDL::Frame(KDL::Rotation::RotZ(M_PI / 2.0)) * frameTCP;
+                        frameTCP = KDL::Frame(KDL::Rotation::RotX(M_PI / 2.0)) * frameTCP;
+                        KDL::Frame frameGraspingWrtObject = frameTCP;
+                        for (int sign = 1.0; sign >= -1; sign -= 2.0)
+                        {
+                            frameGraspingWrtObject.p = KDL::Vector(sign * x, 0, yaxes * params[2]);
+                            addGrasp(frameObjectWrtWorld, frameGraspingWrtObject, grasps);
+                        }
+                    }
+                }
+                addFrontGrasps(params, step, frameObjectWrtWorld, grasps);
+            }
+        }
+    }
+}
+
+#endif
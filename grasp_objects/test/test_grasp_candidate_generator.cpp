@@ -0,0 +1,124 @@
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "grasp_objects/grasp_candidate_generator.hpp"
+#include "grasp_candidates_reference.hpp"
+
+using namespace grasp_objects;
+
+namespace
+{
+    /** Semi-axes of the sharon_objects models and of a plate too wide to grasp along two of its axes. */
+    std::vector<Eigen::Vector3d> objectSizes()
+    {
+        return {Eigen::Vector3d(0.032, 0.037, 0.1125), Eigen::Vector3d(0.04, 0.1, 0.165), Eigen::Vector3d(0.0642, 0.0642, 0.06985),
+                Eigen::Vector3d(0.037, 0.1125, 0.032), Eigen::Vector3d(0.11, 0.12, 0.01)};
+    }
+
+    Eigen::VectorXd superquadric(const Eigen::Vector3d &semiAxes, std::mt19937 &rng)
+    {
+        std::uniform_real_distribution<double> angle(-M_PI, M_PI);
+        std::uniform_real_distribution<double> offset(-0.2, 0.2);
+        Eigen::VectorXd params(11);
+        params << semiAxes, 0.1, 0.1, 0.6 + offset(rng), offset(rng), 0.8 + offset(rng), angle(rng), angle(rng), angle(rng);
+        return params;
+    }
+
+    bool samePose(const Eigen::Vector3f &position, const Eigen::Quaternionf &orientation, const KDL::Frame &frame)
+    {
+        double x, y, z, w;
+        frame.M.GetQuaternion(x, y, z, w);
+        Eigen::Vector3f framePosition(frame.p.x(), frame.p.y(), frame.p.z());
+        // q and -q are the same rotation
+        return (position - framePosition).norm() < 1e-5f && std::abs(orientation.dot(Eigen::Quaternionf(w, x, y, z))) > 1.0f - 1e-5f;
+    }
+
+    /** Removes the repeated poses of the original loops, the x = 0 samples and the faces visited by both width branches. */
+    std::vector<KDL::Frame> uniquePoses(const std::vector<KDL::Frame> &frames)
+    {
+        std::vector<KDL::Frame> unique;
+        for (const KDL::Frame &frame : frames)
+        {
+            bool repeated = false;
+            for (const KDL::Frame &kept : unique)
+                repeated = repeated || KDL::Equal(frame, kept, 1e-5);
+            if (!repeated)
+                unique.push_back(frame);
+        }
+        return unique;
+    }
+}
+
+TEST(GraspCandidateGenerator, MatchesTheKdlLoopsPoseForPose)
+{
+    const float step = 0.025;
+    GraspCandidateGenerator generator(step, GRASP_FACE_ALL, 0.16);
+    std::mt19937 rng(1);
+    for (const Eigen::Vector3d &semiAxes : objectSizes())
+    {
+        for (int trial = 0; trial < 20; trial++)
+        {
+            Eigen::VectorXd params = superquadric(semiAxes, rng);
+            GraspCandidates candidates;
+            generator.generate(params, candidates);
+            std::vector<KDL::Frame> expected;
+            reference::graspPoses(params, step, 0.16, expected);
+            expected = uniquePoses(expected);
+
+            ASSERT_EQ(candidates.size(), (int)expected.size()) << "semi-axes " << semiAxes.transpose() << ", trial " << trial;
+            std::vector<bool> matched(expected.size(), false);
+            for (int i = 0; i < candidates.size(); i++)
+            {
+                Eigen::Vector3f position = candidates.positions.col(i);
+                Eigen::Quaternionf orientation(candidates.orientations.col(i));
+                int match = -1;
+                for (size_t k = 0; k < expected.size() && match < 0; k++)
+                {
+                    if (!matched[k] && samePose(position, orientation, expected[k]))
+                        match = k;
+                }
+                ASSERT_GE(match, 0) << "candidate " << i << " at " << position.transpose() << " is not in the KDL loops";
+                matched[match] = true;
+
+                KDL::Vector approach = expected[match].M.UnitX();
+                EXPECT_LT((candidates.approaches.col(i) - Eigen::Vector3f(approach.x(), approach.y(), approach.z())).norm(), 1e-5f);
+            }
+        }
+    }
+}
+
+TEST(GraspCandidateGenerator, OnlyGeneratesTheSelectedFaces)
+{
+    GraspCandidateGenerator generator(0.025, GRASP_FACE_ALL, 0.16);
+    std::mt19937 rng(2);
+    // Upright milk box, z of the superquadric up: the x and y faces are grasped from the side, the z faces from above and below
+    Eigen::VectorXd params = superquadric(Eigen::Vector3d(0.032, 0.037, 0.1125), rng);
+    params.tail<3>().setZero();
+
+    GraspCandidates all, x, y, z;
+    generator.generate(params, all);
+    generator.setFaces(GRASP_FACE_X);
+    generator.generate(params, x);
+    generator.setFaces(GRASP_FACE_Y);
+    generator.generate(params, y);
+    generator.setFaces(GRASP_FACE_Z);
+    generator.generate(params, z);
+    EXPECT_EQ(all.size(), x.size() + y.size() + z.size());
+    EXPECT_GT(x.size(), 0);
+    EXPECT_GT(z.size(), 0);
+    EXPECT_EQ(y.size(), 0) << "faces normal to y need the z axis narrower than the gripper";
+
+    EXPECT_FALSE(generator.setFaces(std::vector<std::string>{"w"}));
+    EXPECT_TRUE(generator.setFaces(std::vector<std::string>{"x", "z"}));
+    GraspCandidates xz;
+    generator.generate(params, xz);
+    EXPECT_EQ(xz.size(), x.size() + z.size());
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,69 @@
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "grasp_objects/gripper_collision_filter.hpp"
+
+using namespace grasp_objects;
+
+namespace
+{
+    /** One candidate at the origin with the grasp frame aligned to the base. */
+    GraspCandidates candidateAtOrigin()
+    {
+        GraspCandidates candidates;
+        candidates.positions = Eigen::Matrix3Xf::Zero(3, 1);
+        candidates.orientations.resize(4, 1);
+        candidates.orientations << 0, 0, 0, 1;
+        candidates.approaches = Eigen::Vector3f::UnitX();
+        return candidates;
+    }
+
+    /** Sphere of 1 cm radius. */
+    Eigen::VectorXd sphereAt(const Eigen::Vector3d &center)
+    {
+        Eigen::VectorXd params(11);
+        params << 0.01, 0.01, 0.01, 1.0, 1.0, center, 0.0, 0.0, 0.0;
+        return params;
+    }
+
+    /** @return true if the default gripper at the origin collides with the neighbor. */
+    bool collides(const Eigen::VectorXd &neighbor)
+    {
+        GripperCollisionFilter filter;
+        std::vector<int> free;
+        // A zero plane disables the table check
+        filter.filter(candidateAtOrigin(), {neighbor}, Eigen::Vector4f::Zero(), free);
+        return free.empty();
+    }
+}
+
+TEST(GripperCollisionFilter, NeighborOnTheClosingAxisCollides)
+{
+    EXPECT_TRUE(collides(sphereAt(Eigen::Vector3d(0.0, 0.0, 0.0525))));
+    EXPECT_TRUE(collides(sphereAt(Eigen::Vector3d(0.0, 0.0, -0.0525))));
+}
+
+TEST(GripperCollisionFilter, NeighborBesideTheFingersIsFree)
+{
+    // Grasp y is the direction candidates slide along a face, the fingers are thin across it
+    EXPECT_FALSE(collides(sphereAt(Eigen::Vector3d(0.0, 0.0525, 0.0))));
+    EXPECT_FALSE(collides(sphereAt(Eigen::Vector3d(0.0, -0.0525, 0.0))));
+}
+
+TEST(GripperCollisionFilter, TableBelowTheFingersCollides)
+{
+    GripperCollisionFilter filter;
+    std::vector<int> free;
+    // Table 5 cm below the grasp point, the lower finger reaches 6 cm down
+    filter.filter(candidateAtOrigin(), {}, Eigen::Vector4f(0, 0, 1, 0.05), free);
+    EXPECT_TRUE(free.empty());
+    filter.filter(candidateAtOrigin(), {}, Eigen::Vector4f(0, 0, 1, 0.2), free);
+    EXPECT_EQ(free.size(), 1u);
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
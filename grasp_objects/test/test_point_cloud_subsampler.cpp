@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "grasp_objects/point_cloud_subsampler.hpp"
+
+using namespace grasp_objects;
+
+namespace
+{
+    /** Box surface with one face 20 times denser than the others, as a face seen straight by the camera is. */
+    pcl::PointCloud<pcl::PointXYZRGB> unevenBox(unsigned seed = 1)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> s(-1.0f, 1.0f);
+        const Eigen::Vector3f a(0.04f, 0.1f, 0.165f);
+        pcl::PointCloud<pcl::PointXYZRGB> cloud;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            int n = axis == 0 ? 20000 : 1000;
+            for (int i = 0; i < n; i++)
+            {
+                Eigen::Vector3f p(s(rng) * a[0], s(rng) * a[1], s(rng) * a[2]);
+                p[axis] = -a[axis];
+                pcl::PointXYZRGB point;
+                point.getVector3fMap() = p;
+                cloud.push_back(point);
+            }
+        }
+        return cloud;
+    }
+
+    /** @return selected points on the face normal to axis. */
+    int pointsOnFace(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, const std::vector<int> &indices, int axis)
+    {
+        const Eigen::Vector3f a(0.04f, 0.1f, 0.165f);
+        return std::count_if(indices.begin(), indices.end(), [&](int i)
+                             { return std::abs(cloud.points[i].getVector3fMap()[axis] + a[axis]) < 1e-6f; });
+    }
+}
+
+TEST(PointCloudSubsampler, KeepsSmallCloudsWhole)
+{
+    pcl::PointCloud<pcl::PointXYZRGB> cloud = unevenBox();
+    std::vector<int> indices;
+    voxelStratifiedSubsample(cloud, cloud.size(), indices);
+    ASSERT_EQ(indices.size(), cloud.size());
+    for (int i = 0; i < (int)indices.size(); i++)
+        EXPECT_EQ(indices[i], i);
+}
+
+TEST(PointCloudSubsampler, RespectsTheBudgetWithSortedUniqueIndices)
+{
+    pcl::PointCloud<pcl::PointXYZRGB> cloud = unevenBox();
+    for (int budget : {50, 200, 800, 3000})
+    {
+        std::vector<int> indices;
+        voxelStratifiedSubsample(cloud, budget, indices);
+        EXPECT_LE((int)indices.size(), budget);
+        EXPECT_GE((int)indices.size(), 0.8 * budget) << "budget " << budget;
+        EXPECT_TRUE(std::is_sorted(indices.begin(), indices.end()));
+        EXPECT_EQ(std::set<int>(indices.begin(), indices.end()).size(), indices.size());
+        for (int index : indices)
+        {
+            EXPECT_GE(index, 0);
+            EXPECT_LT(index, (int)cloud.size());
+        }
+    }
+}
+
+TEST(PointCloudSubsampler, IsDeterministic)
+{
+    pcl::PointCloud<pcl::PointXYZRGB> cloud = unevenBox();
+    std::vector<int> first, second;
+    voxelStratifiedSubsample(cloud, 800, first);
+    voxelStratifiedSubsample(cloud, 800, second);
+    EXPECT_EQ(first, second);
+}
+
+TEST(PointCloudSubsampler, SamplesFacesByAreaNotByDensity)
+{
+    // A random subsample keeps the density of the cloud, 20 of every 22 points on the dense face
+    pcl::PointCloud<pcl::PointXYZRGB> cloud = unevenBox();
+    std::vector<int> indices;
+    voxelStratifiedSubsample(cloud, 800, indices);
+    const Eigen::Vector3f a(0.04f, 0.1f, 0.165f);
+    float area[3] = {a[1] * a[2], a[0] * a[2], a[0] * a[1]};
+    float totalArea = area[0] + area[1] + area[2];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float fraction = (float)pointsOnFace(cloud, indices, axis) / indices.size();
+        EXPECT_NEAR(fraction, area[axis] / totalArea, 0.1f) << "face " << axis;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
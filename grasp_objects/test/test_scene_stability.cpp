@@ -0,0 +1,137 @@
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "grasp_objects/scene_stability.hpp"
+
+using namespace grasp_objects;
+
+namespace
+{
+    Eigen::VectorXd object(const Eigen::Vector3d &axes, const Eigen::Vector3d &centroid)
+    {
+        Eigen::VectorXd params(11);
+        params << axes, 0.1, 0.1, centroid, 0.0, 0.0, 0.0;
+        return params;
+    }
+
+    /** Milk box and cereal box 20 cm apart. */
+    std::vector<Eigen::VectorXd> scene()
+    {
+        return {object(Eigen::Vector3d(0.032, 0.037, 0.1125), Eigen::Vector3d(0.5, 0.0, 0.9)),
+                object(Eigen::Vector3d(0.04, 0.1, 0.165), Eigen::Vector3d(0.5, 0.2, 0.9))};
+    }
+
+    SceneStabilityDetector detector(int frames)
+    {
+        SceneStabilityParams params;
+        params.frames = frames;
+        SceneStabilityDetector detector;
+        detector.setParams(params);
+        return detector;
+    }
+}
+
+TEST(SceneStabilityDetector, StableAfterFramesIdenticalScenes)
+{
+    SceneStabilityDetector stability = detector(3);
+    EXPECT_FALSE(stability.update(scene()));
+    EXPECT_FALSE(stability.update(scene()));
+    EXPECT_TRUE(stability.update(scene()));
+    EXPECT_EQ(stability.consistentFrames(), 3);
+    EXPECT_TRUE(stability.update(scene()));
+}
+
+TEST(SceneStabilityDetector, FramesAreAtLeastTwo)
+{
+    SceneStabilityDetector stability = detector(1);
+    EXPECT_FALSE(stability.update(scene()));
+    EXPECT_TRUE(stability.update(scene()));
+}
+
+TEST(SceneStabilityDetector, ObjectCountChangeResets)
+{
+    SceneStabilityDetector stability = detector(3);
+    stability.update(scene());
+    stability.update(scene());
+    EXPECT_TRUE(stability.update(scene()));
+
+    std::vector<Eigen::VectorXd> fewer = scene();
+    fewer.pop_back();
+    EXPECT_FALSE(stability.update(fewer));
+    EXPECT_EQ(stability.consistentFrames(), 1);
+    EXPECT_FALSE(stability.update(scene()));
+    EXPECT_EQ(stability.consistentFrames(), 1);
+}
+
+TEST(SceneStabilityDetector, OrderAndAxisPermutationsAreConsistent)
+{
+    SceneStabilityDetector stability = detector(2);
+    stability.update(scene());
+
+    // Segment labels change between frames and the estimator may swap the semi-axes of an object
+    std::vector<Eigen::VectorXd> permuted = scene();
+    std::swap(permuted[0], permuted[1]);
+    permuted[0].head<3>() = Eigen::Vector3d(0.165, 0.04, 0.1);
+    permuted[1].head<3>() = Eigen::Vector3d(0.037, 0.1125, 0.032);
+    EXPECT_TRUE(stability.update(permuted));
+    EXPECT_FLOAT_EQ(stability.confidence(), 1.0f);
+}
+
+TEST(SceneStabilityDetector, CentroidDriftResets)
+{
+    SceneStabilityDetector stability = detector(2);
+    stability.update(scene());
+    EXPECT_TRUE(stability.update(scene()));
+
+    std::vector<Eigen::VectorXd> moved = scene();
+    moved[1][6] += 0.02;
+    EXPECT_FALSE(stability.update(moved));
+    EXPECT_EQ(stability.consistentFrames(), 1);
+    EXPECT_TRUE(stability.update(moved));
+}
+
+TEST(SceneStabilityDetector, AxisChangeAboveThresholdResets)
+{
+    SceneStabilityDetector stability = detector(2);
+    stability.update(scene());
+
+    std::vector<Eigen::VectorXd> grown = scene();
+    grown[0][2] += 0.02;
+    EXPECT_FALSE(stability.update(grown));
+    EXPECT_EQ(stability.consistentFrames(), 1);
+}
+
+TEST(SceneStabilityDetector, ConfidenceFallsWithTheChange)
+{
+    SceneStabilityDetector stability = detector(2);
+    EXPECT_FLOAT_EQ(stability.confidence(), 0.0f);
+    stability.update(scene());
+    EXPECT_FLOAT_EQ(stability.confidence(), 0.0f);
+
+    // Half the centroid drift threshold is the largest relative change
+    std::vector<Eigen::VectorXd> moved = scene();
+    moved[0][5] += 0.005;
+    EXPECT_TRUE(stability.update(moved));
+    EXPECT_NEAR(stability.confidence(), 0.5f, 1e-4);
+
+    EXPECT_TRUE(stability.update(moved));
+    EXPECT_FLOAT_EQ(stability.confidence(), 1.0f);
+}
+
+TEST(SceneStabilityDetector, ResetForgetsThePreviousScenes)
+{
+    SceneStabilityDetector stability = detector(2);
+    stability.update(scene());
+    EXPECT_TRUE(stability.update(scene()));
+    stability.reset();
+    EXPECT_FALSE(stability.stable());
+    EXPECT_FLOAT_EQ(stability.confidence(), 0.0f);
+    EXPECT_FALSE(stability.update(scene()));
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,156 @@
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "grasp_objects/superquadric_kernels.hpp"
+
+using namespace grasp_objects;
+
+namespace
+{
+    /** Points in a box around the superquadrics, 37 so the batched kernels also run their scalar tail. */
+    struct Points
+    {
+        explicit Points(int n, unsigned seed = 1) : x(n), y(n), z(n)
+        {
+            std::mt19937 rng(seed);
+            std::uniform_real_distribution<float> coordinate(-0.15f, 0.15f);
+            for (int i = 0; i < n; i++)
+            {
+                x[i] = 0.5f + coordinate(rng);
+                y[i] = -0.1f + coordinate(rng);
+                z[i] = 0.8f + coordinate(rng);
+            }
+        }
+
+        int size() const { return x.size(); }
+
+        std::vector<float> x, y, z;
+    };
+
+    std::vector<Eigen::VectorXd> testShapes()
+    {
+        std::vector<Eigen::VectorXd> shapes;
+        Eigen::VectorXd box(11), cylinder(11), ellipsoid(11);
+        box << 0.03, 0.05, 0.1, 0.1, 0.1, 0.5, -0.1, 0.8, 0.3, 0.2, -0.4;
+        cylinder << 0.04, 0.04, 0.07, 0.1, 1.0, 0.52, -0.08, 0.79, 0.0, 0.0, 0.0;
+        ellipsoid << 0.06, 0.04, 0.05, 1.0, 1.0, 0.48, -0.12, 0.82, 1.2, -0.7, 0.5;
+        shapes.push_back(box);
+        shapes.push_back(cylinder);
+        shapes.push_back(ellipsoid);
+        return shapes;
+    }
+
+    /** Relative error with an absolute floor, so values near 0 are compared in absolute terms. */
+    float relativeError(float value, float reference, float floor)
+    {
+        return std::abs(value - reference) / std::max(std::abs(reference), floor);
+    }
+}
+
+// With GRASP_OBJECTS_AVX2 the batched kernels run the AVX2 path, the per point functions always run the scalar one
+
+TEST(SuperquadricKernels, BatchedInsideOutsideMatchesScalar)
+{
+    Points points(37);
+    std::vector<float> f(points.size());
+    for (const Eigen::VectorXd &params : testShapes())
+    {
+        kernels::SuperquadricShape shape = kernels::makeShape(params);
+        kernels::insideOutside(shape, points.x.data(), points.y.data(), points.z.data(), f.data(), points.size());
+        for (int i = 0; i < points.size(); i++)
+            EXPECT_LT(relativeError(f[i], kernels::insideOutside(shape, points.x[i], points.y[i], points.z[i]), 1e-3f), 1e-5f) << "point " << i;
+    }
+}
+
+TEST(SuperquadricKernels, BatchedRadialDistanceMatchesScalar)
+{
+    Points points(37);
+    std::vector<float> d(points.size());
+    for (const Eigen::VectorXd &params : testShapes())
+    {
+        kernels::SuperquadricShape shape = kernels::makeShape(params);
+        kernels::radialDistance(shape, points.x.data(), points.y.data(), points.z.data(), d.data(), points.size());
+        for (int i = 0; i < points.size(); i++)
+            EXPECT_NEAR(d[i], kernels::radialDistance(shape, points.x[i], points.y[i], points.z[i]), 2e-6f) << "point " << i;
+    }
+}
+
+TEST(SuperquadricKernels, BatchedSignedPowMatchesScalar)
+{
+    std::vector<float> v = {-2.0f, -1.0f, -0.3f, -1e-3f, 0.0f, 1e-3f, 0.3f, 1.0f, 2.0f, 5.0f, -5.0f};
+    std::vector<float> out(v.size());
+    for (float e : {0.1f, 0.5f, 1.0f, 2.0f})
+    {
+        kernels::signedPow(v.data(), e, out.data(), v.size());
+        for (size_t i = 0; i < v.size(); i++)
+            EXPECT_LT(relativeError(out[i], std::copysign(std::pow(std::abs(v[i]), e), v[i]), 1e-6f), 1e-5f) << v[i] << "^" << e;
+    }
+}
+
+TEST(SuperquadricKernels, BatchedGradientMatchesScalar)
+{
+    Points points(37);
+    int n = points.size();
+    std::vector<float> gx(n), gy(n), gz(n);
+    for (const Eigen::VectorXd &params : testShapes())
+    {
+        kernels::SuperquadricShape shape = kernels::makeShape(params);
+        kernels::gradient(shape, points.x.data(), points.y.data(), points.z.data(), gx.data(), gy.data(), gz.data(), n);
+        for (int i = 0; i < n; i++)
+        {
+            float sx, sy, sz;
+            kernels::detail::gradient(shape, points.x[i], points.y[i], points.z[i], sx, sy, sz);
+            float scale = std::max(Eigen::Vector3f(sx, sy, sz).norm(), 1e-3f);
+            EXPECT_LT((Eigen::Vector3f(gx[i], gy[i], gz[i]) - Eigen::Vector3f(sx, sy, sz)).norm() / scale, 1e-5f) << "point " << i;
+        }
+    }
+}
+
+TEST(SuperquadricKernels, GradientMatchesFiniteDifferences)
+{
+    Points points(37, 2);
+    int n = points.size();
+    std::vector<float> gx(n), gy(n), gz(n);
+    const float h = 1e-4f;
+    for (const Eigen::VectorXd &params : testShapes())
+    {
+        kernels::SuperquadricShape shape = kernels::makeShape(params);
+        kernels::gradient(shape, points.x.data(), points.y.data(), points.z.data(), gx.data(), gy.data(), gz.data(), n);
+        for (int i = 0; i < n; i++)
+        {
+            float x = points.x[i], y = points.y[i], z = points.z[i];
+            Eigen::Vector3f numeric((kernels::insideOutside(shape, x + h, y, z) - kernels::insideOutside(shape, x - h, y, z)) / (2 * h),
+                                    (kernels::insideOutside(shape, x, y + h, z) - kernels::insideOutside(shape, x, y - h, z)) / (2 * h),
+                                    (kernels::insideOutside(shape, x, y, z + h) - kernels::insideOutside(shape, x, y, z - h)) / (2 * h));
+            Eigen::Vector3f analytic(gx[i], gy[i], gz[i]);
+            // Central differences in float, a few percent is the accuracy they reach with this step
+            EXPECT_LT((analytic - numeric).norm() / std::max(numeric.norm(), 1.0f), 0.03f) << "point " << i;
+        }
+    }
+}
+
+TEST(SuperquadricKernels, InsideOutsideMinIsTheMinimumOverShapes)
+{
+    Points points(37);
+    std::vector<kernels::SuperquadricShape> shapes;
+    for (const Eigen::VectorXd &params : testShapes())
+        shapes.push_back(kernels::makeShape(params));
+    std::vector<float> f(points.size());
+    kernels::insideOutsideMin(shapes, points.x.data(), points.y.data(), points.z.data(), f.data(), points.size());
+    for (int i = 0; i < points.size(); i++)
+    {
+        float expected = std::numeric_limits<float>::max();
+        for (const kernels::SuperquadricShape &shape : shapes)
+            expected = std::min(expected, kernels::insideOutside(shape, points.x[i], points.y[i], points.z[i]));
+        EXPECT_LT(relativeError(f[i], expected, 1e-3f), 1e-5f) << "point " << i;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,100 @@
+#ifndef SHARON_RVIZ_PLUGINS_SUPERQUADRIC_ARRAY_DISPLAY_HPP
+#define SHARON_RVIZ_PLUGINS_SUPERQUADRIC_ARRAY_DISPLAY_HPP
+
+#ifndef Q_MOC_RUN
+#include <array>
+#include <list>
+#include <map>
+#include <string>
+
+#include <OgreMaterial.h>
+#include <OgreMesh.h>
+
+#include <rviz/message_filter_display.h>
+
+#include "sharon_msgs/SuperquadricMultiArray.h"
+#endif
+
+namespace Ogre
+{
+    class Entity;
+    class SceneNode;
+}
+
+namespace rviz
+{
+    class ColorProperty;
+    class FloatProperty;
+    class IntProperty;
+}
+
+namespace sharon_rviz_plugins
+{
+    /** Displays a sharon_msgs/SuperquadricMultiArray by tessellating each superquadric on the client.
+     * Meshes are cached per (a1, a2, a3, e1, e2), so when only the pose of an object changes its scene node
+     * is moved and nothing is tessellated again. The meshes no visual uses are kept in a small LRU, so a fit
+     * that jitters between neighboring shapes keeps reusing the same few meshes.
+     */
+    class SuperquadricArrayDisplay : public rviz::MessageFilterDisplay<sharon_msgs::SuperquadricMultiArray>
+    {
+        Q_OBJECT
+    public:
+        SuperquadricArrayDisplay();
+
+        ~SuperquadricArrayDisplay() override;
+
+    protected:
+        void onInitialize() override;
+
+        void reset() override;
+
+    private Q_SLOTS:
+        void updateMaterial();
+
+        void updateResolution();
+
+    private:
+        typedef std::array<int, 5> ShapeKey;
+
+        struct CachedMesh
+        {
+            Ogre::MeshPtr mesh;
+            int users = 0;
+            std::list<ShapeKey>::iterator released; /**< position in released_, only valid when users is 0*/
+        };
+
+        struct SuperquadricVisual
+        {
+            ShapeKey shape;
+            Ogre::SceneNode *node = nullptr;
+            Ogre::Entity *entity = nullptr;
+        };
+
+        void processMessage(const sharon_msgs::SuperquadricMultiArray::ConstPtr &msg) override;
+
+        ShapeKey shapeKey(const sharon_msgs::Superquadric &superq) const;
+
+        /** Returns the cached mesh of a shape, tessellating it the first time. */
+        const Ogre::MeshPtr &acquireMesh(const ShapeKey &shape);
+
+        /** Moves a mesh no visual uses anymore to the front of the released meshes, destroying the oldest ones past their limit. */
+        void releaseMesh(const ShapeKey &shape);
+
+        void destroyVisual(SuperquadricVisual &visual);
+
+        void clearVisuals();
+
+        void clearMeshes();
+
+        rviz::ColorProperty *colorProperty_;
+        rviz::FloatProperty *alphaProperty_;
+        rviz::IntProperty *resolutionProperty_;
+
+        Ogre::MaterialPtr material_;
+        std::map<ShapeKey, CachedMesh> meshes_;
+        std::list<ShapeKey> released_; /**< unused meshes, most recently released first*/
+        std::map<int, SuperquadricVisual> visuals_; /**< visuals by superquadric id*/
+    };
+}
+
+#endif
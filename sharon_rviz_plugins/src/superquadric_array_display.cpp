@@ -0,0 +1,261 @@
+#include "sharon_rviz_plugins/superquadric_array_display.hpp"
+
+#include <cmath>
+#include <set>
+
+#include <OgreEntity.h>
+#include <OgreManualObject.h>
+#include <OgreMaterialManager.h>
+#include <OgreMeshManager.h>
+#include <OgreSceneManager.h>
+#include <OgreSceneNode.h>
+#include <OgreTechnique.h>
+
+#include <rviz/frame_manager.h>
+#include <rviz/properties/color_property.h>
+#include <rviz/properties/float_property.h>
+#include <rviz/properties/int_property.h>
+
+// Shapes closer than these resolutions share a mesh
+#define AXES_RESOLUTION 0.002
+#define EXPONENT_RESOLUTION 0.02
+// Meshes kept after their last visual is destroyed
+#define MAX_RELEASED_MESHES 32
+
+namespace sharon_rviz_plugins
+{
+    namespace
+    {
+        inline float signedPow(float v, float e)
+        {
+            return std::copysign(std::pow(std::abs(v), e), v);
+        }
+    }
+
+    SuperquadricArrayDisplay::SuperquadricArrayDisplay()
+    {
+        colorProperty_ = new rviz::ColorProperty("Color", QColor(0, 120, 255), "Color of the superquadrics.", this, SLOT(updateMaterial()));
+        alphaProperty_ = new rviz::FloatProperty("Alpha", 0.7, "Opacity of the superquadrics.", this, SLOT(updateMaterial()));
+        alphaProperty_->setMin(0.0);
+        alphaProperty_->setMax(1.0);
+        resolutionProperty_ = new rviz::IntProperty("Resolution", 24, "Number of rings from pole to pole of each superquadric.",
+                                                    this, SLOT(updateResolution()));
+        resolutionProperty_->setMin(4);
+        resolutionProperty_->setMax(128);
+    }
+
+    SuperquadricArrayDisplay::~SuperquadricArrayDisplay()
+    {
+        if (initialized())
+        {
+            clearVisuals();
+            clearMeshes();
+            Ogre::MaterialManager::getSingleton().remove(material_->getName());
+        }
+    }
+
+    void SuperquadricArrayDisplay::onInitialize()
+    {
+        MFDClass::onInitialize();
+
+        static int count = 0;
+        material_ = Ogre::MaterialManager::getSingleton().create("SuperquadricArrayDisplayMaterial" + std::to_string(count++),
+                                                                 Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        material_->setReceiveShadows(false);
+        material_->getTechnique(0)->setLightingEnabled(true);
+        updateMaterial();
+    }
+
+    void SuperquadricArrayDisplay::reset()
+    {
+        MFDClass::reset();
+        clearVisuals();
+    }
+
+    void SuperquadricArrayDisplay::updateMaterial()
+    {
+        Ogre::ColourValue color = colorProperty_->getOgreColor();
+        color.a = alphaProperty_->getFloat();
+        material_->getTechnique(0)->setAmbient(color * 0.5f);
+        material_->getTechnique(0)->setDiffuse(color);
+        if (color.a < 0.9998)
+        {
+            material_->getTechnique(0)->setSceneBlending(Ogre::SBT_TRANSPARENT_ALPHA);
+            material_->getTechnique(0)->setDepthWriteEnabled(false);
+        }
+        else
+        {
+            material_->getTechnique(0)->setSceneBlending(Ogre::SBT_REPLACE);
+            material_->getTechnique(0)->setDepthWriteEnabled(true);
+        }
+        context_->queueRender();
+    }
+
+    void SuperquadricArrayDisplay::updateResolution()
+    {
+        // Meshes must be tessellated again, the next message recreates them
+        clearVisuals();
+        clearMeshes();
+    }
+
+    SuperquadricArrayDisplay::ShapeKey SuperquadricArrayDisplay::shapeKey(const sharon_msgs::Superquadric &superq) const
+    {
+        return {(int)std::lround(superq.a1 / AXES_RESOLUTION), (int)std::lround(superq.a2 / AXES_RESOLUTION),
+                (int)std::lround(superq.a3 / AXES_RESOLUTION), (int)std::lround(superq.e1 / EXPONENT_RESOLUTION),
+                (int)std::lround(superq.e2 / EXPONENT_RESOLUTION)};
+    }
+
+    const Ogre::MeshPtr &SuperquadricArrayDisplay::acquireMesh(const ShapeKey &shape)
+    {
+        CachedMesh &cached = meshes_[shape];
+        if (!cached.mesh.isNull() && cached.users == 0)
+            released_.erase(cached.released);
+        cached.users++;
+        if (!cached.mesh.isNull())
+            return cached.mesh;
+
+        // The normals divide by the semi-axes, a semi-axis quantized to 0 is clamped like the exponents
+        float a1 = std::max(shape[0] * AXES_RESOLUTION, AXES_RESOLUTION), a2 = std::max(shape[1] * AXES_RESOLUTION, AXES_RESOLUTION);
+        float a3 = std::max(shape[2] * AXES_RESOLUTION, AXES_RESOLUTION);
+        float e1 = std::max(shape[3] * EXPONENT_RESOLUTION, EXPONENT_RESOLUTION);
+        float e2 = std::max(shape[4] * EXPONENT_RESOLUTION, EXPONENT_RESOLUTION);
+        int nEta = resolutionProperty_->getInt() + 1;
+        int nOmega = 2 * resolutionProperty_->getInt();
+
+        Ogre::ManualObject *manual = scene_manager_->createManualObject();
+        manual->begin("BaseWhiteNoLighting", Ogre::RenderOperation::OT_TRIANGLE_LIST);
+        for (int i = 0; i < nEta; i++)
+        {
+            float eta = -M_PI / 2.0 + M_PI * i / (nEta - 1);
+            float ce = std::cos(eta), se = std::sin(eta);
+            for (int j = 0; j < nOmega; j++)
+            {
+                float omega = -M_PI + 2.0 * M_PI * j / nOmega;
+                float co = std::cos(omega), so = std::sin(omega);
+                manual->position(a1 * signedPow(ce, e1) * signedPow(co, e2), a2 * signedPow(ce, e1) * signedPow(so, e2), a3 * signedPow(se, e1));
+                Ogre::Vector3 normal(signedPow(ce, 2 - e1) * signedPow(co, 2 - e2) / a1, signedPow(ce, 2 - e1) * signedPow(so, 2 - e2) / a2,
+                                     signedPow(se, 2 - e1) / a3);
+                normal.normalise();
+                manual->normal(normal);
+            }
+        }
+        for (int i = 0; i + 1 < nEta; i++)
+        {
+            for (int j = 0; j < nOmega; j++)
+            {
+                int a = i * nOmega + j, b = i * nOmega + (j + 1) % nOmega;
+                int c = a + nOmega, d = b + nOmega;
+                manual->triangle(a, b, d);
+                manual->triangle(a, d, c);
+            }
+        }
+        manual->end();
+
+        // Mesh names are global to Ogre, shared by every display of the session
+        static int meshCount = 0;
+        cached.mesh = manual->convertToMesh("SuperquadricArrayDisplayMesh" + std::to_string(meshCount++));
+        scene_manager_->destroyManualObject(manual);
+        return cached.mesh;
+    }
+
+    void SuperquadricArrayDisplay::releaseMesh(const ShapeKey &shape)
+    {
+        auto it = meshes_.find(shape);
+        if (it == meshes_.end() || --it->second.users > 0)
+            return;
+        released_.push_front(shape);
+        it->second.released = released_.begin();
+
+        while (released_.size() > MAX_RELEASED_MESHES)
+        {
+            auto oldest = meshes_.find(released_.back());
+            Ogre::MeshManager::getSingleton().remove(oldest->second.mesh->getName());
+            meshes_.erase(oldest);
+            released_.pop_back();
+        }
+    }
+
+    void SuperquadricArrayDisplay::destroyVisual(SuperquadricVisual &visual)
+    {
+        if (visual.entity != nullptr)
+        {
+            scene_manager_->destroyEntity(visual.entity);
+            visual.entity = nullptr;
+            releaseMesh(visual.shape);
+        }
+        if (visual.node != nullptr)
+        {
+            scene_manager_->destroySceneNode(visual.node);
+            visual.node = nullptr;
+        }
+    }
+
+    void SuperquadricArrayDisplay::clearVisuals()
+    {
+        for (auto &visual : visuals_)
+            destroyVisual(visual.second);
+        visuals_.clear();
+    }
+
+    void SuperquadricArrayDisplay::clearMeshes()
+    {
+        for (auto &cached : meshes_)
+            Ogre::MeshManager::getSingleton().remove(cached.second.mesh->getName());
+        meshes_.clear();
+        released_.clear();
+    }
+
+    void SuperquadricArrayDisplay::processMessage(const sharon_msgs::SuperquadricMultiArray::ConstPtr &msg)
+    {
+        Ogre::Vector3 position;
+        Ogre::Quaternion orientation;
+        if (!context_->getFrameManager()->getTransform(msg->header.frame_id, msg->header.stamp, position, orientation))
+        {
+            ROS_DEBUG("Error transforming from frame '%s' to frame '%s'", msg->header.frame_id.c_str(), qPrintable(fixed_frame_));
+            return;
+        }
+        scene_node_->setPosition(position);
+        scene_node_->setOrientation(orientation);
+
+        std::set<int> received;
+        for (const sharon_msgs::Superquadric &superq : msg->superquadrics)
+        {
+            received.insert(superq.id);
+            ShapeKey shape = shapeKey(superq);
+            SuperquadricVisual &visual = visuals_[superq.id];
+
+            // Only a new shape needs a new mesh, a new pose just moves the node
+            if (visual.node == nullptr || visual.shape != shape)
+            {
+                destroyVisual(visual);
+                visual.shape = shape;
+                visual.node = scene_node_->createChildSceneNode();
+                visual.entity = scene_manager_->createEntity(acquireMesh(shape)->getName());
+                visual.entity->setMaterial(material_);
+                visual.node->attachObject(visual.entity);
+            }
+
+            Ogre::Quaternion rotation = Ogre::Quaternion(Ogre::Radian(superq.roll), Ogre::Vector3::UNIT_Z) *
+                                        Ogre::Quaternion(Ogre::Radian(superq.pitch), Ogre::Vector3::UNIT_Y) *
+                                        Ogre::Quaternion(Ogre::Radian(superq.yaw), Ogre::Vector3::UNIT_Z);
+            visual.node->setPosition(superq.x, superq.y, superq.z);
+            visual.node->setOrientation(rotation);
+        }
+
+        for (auto it = visuals_.begin(); it != visuals_.end();)
+        {
+            if (received.count(it->first) == 0)
+            {
+                destroyVisual(it->second);
+                it = visuals_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+}
+
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(sharon_rviz_plugins::SuperquadricArrayDisplay, rviz::Display)